@@ -0,0 +1,110 @@
+#ifndef WASMATI_ARENA_H
+#define WASMATI_ARENA_H
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace wasmati {
+
+/// Typed bump allocator: objects derived from T are carved out of large
+/// pages and never freed one by one. The pages are returned to the system
+/// all at once when the arena is destroyed, the owner is responsible for
+/// running the destructors of the objects it created beforehand.
+template <class T>
+class Arena {
+    static const size_t PAGE_SIZE = 1 << 20;
+
+    std::vector<char*> _pages;
+    char* _cursor;
+    char* _end;
+    size_t _reserved;
+    size_t _used;
+    size_t _objects;
+
+public:
+    Arena()
+        : _cursor(nullptr),
+          _end(nullptr),
+          _reserved(0),
+          _used(0),
+          _objects(0) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { release(); }
+
+    template <class U, class... Args>
+    U* make(Args&&... args) {
+        static_assert(std::is_base_of<T, U>::value,
+                      "arena only holds objects of its base type");
+        void* mem = allocate(sizeof(U), alignof(U));
+        _objects++;
+        return new (mem) U(std::forward<Args>(args)...);
+    }
+
+    void* allocate(size_t size, size_t align) {
+        assert(align != 0 && (align & (align - 1)) == 0);
+        size_t padding = paddingFor(align);
+        if (_cursor == nullptr ||
+            padding + size > static_cast<size_t>(_end - _cursor)) {
+            newPage(size + align);
+            padding = paddingFor(align);
+        }
+        char* mem = _cursor + padding;
+        _cursor = mem + size;
+        _used += padding + size;
+        return mem;
+    }
+
+    /// Takes over the pages of other, and with them the objects made in it.
+    /// other is left empty and can make new objects.
+    void adopt(Arena& other) {
+        _pages.insert(_pages.end(), other._pages.begin(), other._pages.end());
+        _reserved += other._reserved;
+        _used += other._used;
+        _objects += other._objects;
+        other._pages.clear();
+        other._cursor = other._end = nullptr;
+        other._reserved = other._used = other._objects = 0;
+    }
+
+    /// Returns every page to the system. Objects are not destroyed.
+    void release() {
+        for (char* page : _pages) {
+            std::free(page);
+        }
+        _pages.clear();
+        _cursor = _end = nullptr;
+        _reserved = _used = _objects = 0;
+    }
+
+    inline size_t numPages() const { return _pages.size(); }
+    inline size_t numObjects() const { return _objects; }
+    inline size_t bytesReserved() const { return _reserved; }
+    inline size_t bytesUsed() const { return _used; }
+
+private:
+    inline size_t paddingFor(size_t align) const {
+        return (align - reinterpret_cast<uintptr_t>(_cursor) % align) % align;
+    }
+
+    void newPage(size_t minSize) {
+        size_t size = minSize > PAGE_SIZE ? minSize : PAGE_SIZE;
+        char* page = static_cast<char*>(std::malloc(size));
+        if (page == nullptr) {
+            throw std::bad_alloc();
+        }
+        _pages.push_back(page);
+        _cursor = page;
+        _end = page + size;
+        _reserved += size;
+    }
+};
+
+}  // namespace wasmati
+
+#endif /* WASMATI_ARENA_H */
@@ -1,102 +1,200 @@
 #include "ast-builder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
 namespace wasmati {
 void AST::generateAST() {
+    beginAST();
+    Module* m = graph.getModule();
+
+    // Code
+    std::vector<std::pair<Func*, Index>> todo;
+    Index func_index = 0;
+    for (auto f : mc.module.funcs) {
+        if (cpgOptions.funcName.empty() ||
+            cpgOptions.funcName.compare(f->name) == 0) {
+            todo.emplace_back(f, func_index);
+        }
+        func_index++;
+    }
+
+    size_t numThreads = std::min<size_t>(cpgOptions.threads, todo.size());
+    if (numThreads <= 1) {
+        for (auto const& kv : todo) {
+            generateFunction(kv.first, kv.second);
+        }
+        endAST();
+        return;
+    }
+
+    // Every thread takes the next function left and makes its nodes in an
+    // arena of its own. The functions are merged once all are built.
+    std::vector<std::unique_ptr<Arena<Node>>> arenas;
+    std::vector<std::unique_ptr<FunctionAST>> functions(todo.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < numThreads; t++) {
+        arenas.emplace_back(new Arena<Node>());
+        Arena<Node>* arena = arenas.back().get();
+        workers.emplace_back([&, arena]() {
+            for (size_t i = next++; i < todo.size(); i = next++) {
+                functions[i].reset(new FunctionAST(mc.module, *arena,
+                                                   todo[i].first,
+                                                   todo[i].second));
+                functions[i]->build();
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (auto& function : functions) {
+        merge(m, *function);
+        function.reset();
+    }
+    for (auto& arena : arenas) {
+        graph.adoptNodes(*arena);
+    }
+    endAST();
+}
+
+void AST::beginAST() {
     Module* m;
     if (mc.module.name.empty()) {
-        m = new Module();
+        m = graph.newNode<Module>();
     } else {
-        m = new Module(mc.module.name);
+        m = graph.newNode<Module>(graph.intern(mc.module.name));
     }
     graph.insertNode(m);
     graph.setModule(m);
+}
 
-    // Code
-    Index func_index = 0;
-    for (auto f : mc.module.funcs) {
-        debug("[DEBUG][AST][%u/%lu] Function %s\n", func_index,
-              mc.module.funcs.size(), f->name.c_str());
-        if (!cpgOptions.funcName.empty() &&
-            cpgOptions.funcName.compare(f->name) != 0) {
-            func_index++;
-            continue;
-        }
-        bool isImport = mc.module.IsImport(ExternalKind::Func, Var(func_index));
-        bool isExport = false;
-        // check if isEXport
-        for (Export* exp : mc.module.exports) {
-            if (exp->kind == ExternalKind::Func && exp->var.is_name() &&
-                exp->var.name() == f->name) {
-                isExport = true;
-                break;
-            }
+void AST::generateFunction(Func* f, Index index) {
+    FunctionAST function(mc.module, _arena, f, index);
+    function.build();
+    merge(graph.getModule(), function);
+}
+
+void AST::endAST() {
+    graph.adoptNodes(_arena);
+    graph.numberAST();
+}
+
+void AST::releaseBody(Func* f) {
+    f->exprs.clear();
+    exprNodes.clear();
+    ifBlocks.clear();
+}
+
+void AST::merge(Module* m, FunctionAST& function) {
+    Func* f = function.f;
+    debug("[DEBUG][AST][%u/%lu] Function %s\n", function.index,
+          mc.module.funcs.size(), f->name.c_str());
+    graph.merge(function.buffer);
+    graph.newEdge<ASTEdge>(m, function.func);
+    funcs[f] = function.func;
+    funcsByName[f->name] = function.func;
+    if (function.returnNode != nullptr) {
+        returnFunc[f] = function.returnNode;
+    }
+    exprNodes.reserve(exprNodes.size() + function.exprNodes.size());
+    for (auto const& kv : function.exprNodes) {
+        exprNodes[kv.first] = kv.second;
+    }
+    for (auto const& kv : function.ifBlocks) {
+        ifBlocks[kv.first] = kv.second;
+    }
+}
+
+size_t AST::getMemoryUsage() const {
+    size_t result = exprNodes.heapBytes() + ifBlocks.heapBytes() +
+                    returnFunc.heapBytes() + funcs.heapBytes() +
+                    memory::heapBytes(funcsByName);
+    for (auto const& kv : funcsByName) {
+        result += memory::heapBytes(kv.first);
+    }
+    return result;
+}
+
+void FunctionAST::build() {
+    bool isImport = mc.module.IsImport(ExternalKind::Func, Var(index));
+    bool isExport = false;
+    // check if isEXport
+    for (Export* exp : mc.module.exports) {
+        if (exp->kind == ExternalKind::Func && exp->var.is_name() &&
+            exp->var.name() == f->name) {
+            isExport = true;
+            break;
         }
-        // Function
-        Function* func = new Function(f, func_index, isImport, isExport);
-        graph.insertNode(func);
-        new ASTEdge(m, func);
-        funcs[f] = func;
-        funcsByName[f->name] = func;
-        // Function Signature
-        FunctionSignature* fsign = new FunctionSignature();
-        graph.insertNode(fsign);
-        new ASTEdge(func, fsign);
-        std::vector<std::string> localsNames;
-        getLocalsNames(f, localsNames);
-        //// Parameters
-        Index numParameters = f->GetNumParams();
-        if (numParameters > 0) {
-            Parameters* parameters = new Parameters();
-            graph.insertNode(parameters);
-            new ASTEdge(fsign, parameters);
+    }
+    // Function
+    func = buffer.newNode<Function>(f, buffer.intern(f->name), index,
+                                    isImport, isExport);
+    buffer.insertNode(func);
+    // Function Signature
+    FunctionSignature* fsign = buffer.newNode<FunctionSignature>();
+    buffer.insertNode(fsign);
+    buffer.newEdge<ASTEdge>(func, fsign);
+    std::vector<std::string> localsNames;
+    getLocalsNames(localsNames);
+    //// Parameters
+    Index numParameters = f->GetNumParams();
+    if (numParameters > 0) {
+        Parameters* parameters = buffer.newNode<Parameters>();
+        buffer.insertNode(parameters);
+        buffer.newEdge<ASTEdge>(fsign, parameters);
 
-            for (Index i = 0; i < numParameters; i++) {
-                VarNode* tnode =
-                    new VarNode(f->GetParamType(i), i, localsNames[i]);
-                graph.insertNode(tnode);
-                new ASTEdge(parameters, tnode);
-            }
+        for (Index i = 0; i < numParameters; i++) {
+            VarNode* tnode =
+                buffer.newNode<VarNode>(f->GetParamType(i), i,
+                                        buffer.intern(localsNames[i]));
+            buffer.insertNode(tnode);
+            buffer.newEdge<ASTEdge>(parameters, tnode);
         }
-        //// Locals
-        Index numLocals = f->GetNumLocals();
-        if (numLocals > 0) {
-            Locals* locals = new Locals();
-            graph.insertNode(locals);
-            new ASTEdge(fsign, locals);
+    }
+    //// Locals
+    Index numLocals = f->GetNumLocals();
+    if (numLocals > 0) {
+        Locals* locals = buffer.newNode<Locals>();
+        buffer.insertNode(locals);
+        buffer.newEdge<ASTEdge>(fsign, locals);
 
-            for (Index i = numParameters; i < f->GetNumParamsAndLocals(); i++) {
-                VarNode* tnode =
-                    new VarNode(f->GetLocalType(i), i, localsNames[i]);
-                graph.insertNode(tnode);
-                new ASTEdge(locals, tnode);
-            }
+        for (Index i = numParameters; i < f->GetNumParamsAndLocals(); i++) {
+            VarNode* tnode =
+                buffer.newNode<VarNode>(f->GetLocalType(i), i,
+                                        buffer.intern(localsNames[i]));
+            buffer.insertNode(tnode);
+            buffer.newEdge<ASTEdge>(locals, tnode);
         }
-        //// Results
-        Index numResults = f->GetNumResults();
-        if (numResults > 0) {
-            Results* results = new Results();
-            graph.insertNode(results);
-            new ASTEdge(fsign, results);
+    }
+    //// Results
+    Index numResults = f->GetNumResults();
+    if (numResults > 0) {
+        Results* results = buffer.newNode<Results>();
+        buffer.insertNode(results);
+        buffer.newEdge<ASTEdge>(fsign, results);
 
-            for (Index i = 0; i < numResults; i++) {
-                VarNode* tnode = new VarNode(f->GetResultType(i), i);
-                graph.insertNode(tnode);
-                new ASTEdge(results, tnode);
-            }
+        for (Index i = 0; i < numResults; i++) {
+            VarNode* tnode = buffer.newNode<VarNode>(f->GetResultType(i), i);
+            buffer.insertNode(tnode);
+            buffer.newEdge<ASTEdge>(results, tnode);
         }
+    }
 
-        if (!isImport) {
-            // Instructions
-            Instructions* inst = new Instructions();
-            graph.insertNode(inst);
-            new ASTEdge(func, inst);
+    if (!isImport) {
+        // Instructions
+        Instructions* inst = buffer.newNode<Instructions>();
+        buffer.insertNode(inst);
+        buffer.newEdge<ASTEdge>(func, inst);
 
-            construct(f->exprs, f->GetNumResults(), inst, f);
-        }
-        func_index++;
+        construct(f->exprs, f->GetNumResults(), inst, true);
     }
 }
 
-void AST::getLocalsNames(Func* f, std::vector<std::string>& names) const {
+void FunctionAST::getLocalsNames(std::vector<std::string>& names) const {
     Index size = f->GetNumParamsAndLocals();
     names.reserve(size);
     for (Index i = 0; i < size; i++) {
@@ -107,9 +205,9 @@ void AST::getLocalsNames(Func* f, std::vector<std::string>& names) const {
     }
 }
 
-void AST::construct(const Expr& e,
-                    std::vector<Node*>& expStack,
-                    std::vector<Node*>& expList) {
+void FunctionAST::construct(const Expr& e,
+                            std::vector<Node*>& expStack,
+                            std::vector<Node*>& expList) {
     auto arity = mc.GetExprArity(e);
     assert(expStack.size() >= arity.nargs);
     assert(arity.nreturns <= 1);
@@ -117,64 +215,64 @@ void AST::construct(const Expr& e,
     switch (e.type()) {
     // Base Instruction
     case ExprType::Nop:
-        node = new NopInst(e.loc);
+        node = buffer.newNode<NopInst>();
         break;
     case ExprType::Unreachable:
-        node = new UnreachableInst(e.loc);
+        node = buffer.newNode<UnreachableInst>();
         break;
     case ExprType::Return:
         arity.unreachable = false;
-        node = new ReturnInst(e.loc);
+        node = buffer.newNode<ReturnInst>();
         break;
     case ExprType::BrTable:
-        node = new BrTableInst(e.loc);
+        node = buffer.newNode<BrTableInst>();
         break;
     case ExprType::Drop:
-        node = new DropInst(e.loc);
+        node = buffer.newNode<DropInst>();
         break;
     case ExprType::Select:
-        node = new SelectInst(e.loc);
+        node = buffer.newNode<SelectInst>();
         break;
     case ExprType::MemorySize:
-        node = new MemorySizeInst(e.loc);
+        node = buffer.newNode<MemorySizeInst>();
         break;
     case ExprType::MemoryGrow:
-        node = new MemoryGrowInst(e.loc);
+        node = buffer.newNode<MemoryGrowInst>();
         break;
     // Const
     case ExprType::Const:
-        node = new ConstInst(cast<ConstExpr>(&e));
+        node = buffer.newNode<ConstInst>(cast<ConstExpr>(&e));
         break;
     // Opcode
     case ExprType::Binary: {
         auto expr = cast<BinaryExpr>(&e);
-        node = new BinaryInst(expr->opcode, expr->loc);
+        node = buffer.newNode<BinaryInst>(expr->opcode);
         break;
     }
     case ExprType::Compare: {
         auto expr = cast<CompareExpr>(&e);
-        node = new CompareInst(expr->opcode, expr->loc);
+        node = buffer.newNode<CompareInst>(expr->opcode);
         break;
     }
     case ExprType::Convert: {
         auto expr = cast<ConvertExpr>(&e);
-        node = new ConvertInst(expr->opcode, expr->loc);
+        node = buffer.newNode<ConvertInst>(expr->opcode);
         break;
     }
     case ExprType::Unary: {
         auto expr = cast<UnaryExpr>(&e);
-        node = new UnaryInst(expr->opcode, expr->loc);
+        node = buffer.newNode<UnaryInst>(expr->opcode);
         break;
     }
     // LoadStore
     case ExprType::Load: {
         auto expr = cast<LoadExpr>(&e);
-        node = new LoadInst(expr->opcode, expr->offset, expr->loc);
+        node = buffer.newNode<LoadInst>(expr->opcode, expr->offset);
         break;
     }
     case ExprType::Store: {
         auto expr = cast<StoreExpr>(&e);
-        node = new StoreInst(expr->opcode, expr->offset, expr->loc);
+        node = buffer.newNode<StoreInst>(expr->opcode, expr->offset);
         break;
     }
     // LabeledInst
@@ -182,68 +280,73 @@ void AST::construct(const Expr& e,
         arity.nargs = 0;
         arity.nreturns = 0;
         auto expr = cast<BrExpr>(&e);
-        node = new BrInst(expr->var.name(), expr->loc);
+        node = buffer.newNode<BrInst>(buffer.intern(expr->var.name()));
         break;
     }
     case ExprType::BrIf: {
         arity.nargs = 1;
         arity.nreturns = 0;
         auto expr = cast<BrIfExpr>(&e);
-        node = new BrIfInst(expr->var.name(), expr->loc);
+        node = buffer.newNode<BrIfInst>(buffer.intern(expr->var.name()));
         break;
     }
     case ExprType::LocalGet: {
         auto expr = cast<LocalGetExpr>(&e);
-        node = new LocalGetInst(expr->var.name(), expr->loc);
+        node = buffer.newNode<LocalGetInst>(buffer.intern(expr->var.name()));
         break;
     }
     case ExprType::LocalSet: {
         auto expr = cast<LocalSetExpr>(&e);
-        node = new LocalSetInst(expr->var.name(), expr->loc);
+        node = buffer.newNode<LocalSetInst>(buffer.intern(expr->var.name()));
         break;
     }
     case ExprType::GlobalGet: {
         auto expr = cast<GlobalGetExpr>(&e);
-        node = new GlobalGetInst(expr->var.name(), expr->loc);
+        node = buffer.newNode<GlobalGetInst>(buffer.intern(expr->var.name()));
         break;
     }
     case ExprType::GlobalSet: {
         auto expr = cast<GlobalSetExpr>(&e);
-        node = new GlobalSetInst(expr->var.name(), expr->loc);
+        node = buffer.newNode<GlobalSetInst>(buffer.intern(expr->var.name()));
         break;
     }
     case ExprType::LocalTee: {
         auto expr = cast<LocalTeeExpr>(&e);
-        node = new LocalTeeInst(expr->var.name(), expr->loc);
+        node = buffer.newNode<LocalTeeInst>(buffer.intern(expr->var.name()));
         break;
     }
         // Call Base
     case ExprType::Call:
-        node = new CallInst(cast<CallExpr>(&e), e.loc, arity.nargs,
-                            arity.nreturns);
+        node = buffer.newNode<CallInst>(
+            buffer.intern(cast<CallExpr>(&e)->var.name()), arity.nargs,
+            arity.nreturns);
         break;
     case ExprType::CallIndirect:
-        node = new CallIndirectInst(cast<CallIndirectExpr>(&e), e.loc,
-                                    arity.nargs, arity.nreturns);
+        node = buffer.newNode<CallIndirectInst>(
+            buffer.intern(cast<CallIndirectExpr>(&e)->table.name()),
+            arity.nargs, arity.nreturns);
         break;
         // Block Base
     case ExprType::Block: {
         auto block = cast<BlockExpr>(&e);
-        node = new BlockInst(block->block.label,
-                             block->block.decl.GetNumResults(), block->loc);
+        Symbol label = buffer.intern(block->block.label);
+        node = buffer.newNode<BlockInst>(label,
+                                        block->block.decl.GetNumResults());
+        buffer.setLocation(node, block->loc);
         mc.BeginBlock(LabelType::Block, block->block);
         construct(block->block.exprs, block->block.decl.GetNumResults(), node);
         mc.EndBlock();
-        auto beginBlock = new BeginBlockInst(block->block.label,
-                                             static_cast<BlockInst*>(node));
-        graph.insertNode(beginBlock);
-        exprNodes[&e] = beginBlock;
+        auto beginBlock = buffer.newNode<BeginBlockInst>(
+            label, static_cast<BlockInst*>(node));
+        buffer.insertNode(beginBlock);
+        exprNodes.emplace_back(&e, beginBlock);
         break;
     }
     case ExprType::Loop: {
         auto loop = cast<LoopExpr>(&e);
-        node = new LoopInst(loop->block.label, loop->block.decl.GetNumResults(),
-                            loop->loc);
+        node = buffer.newNode<LoopInst>(buffer.intern(loop->block.label),
+                                       loop->block.decl.GetNumResults());
+        buffer.setLocation(node, loop->loc);
         mc.BeginBlock(LabelType::Loop, loop->block);
         construct(loop->block.exprs, loop->block.decl.GetNumResults(), node);
         mc.EndBlock();
@@ -251,27 +354,30 @@ void AST::construct(const Expr& e,
     }
     case ExprType::If: {
         auto ife = cast<IfExpr>(&e);
-        node = new IfInst(ife);
-        graph.insertNode(node);
-        exprNodes[&e] = node;
+        node = buffer.newNode<IfInst>(ife);
+        buffer.setLocation(node, ife->loc);
+        buffer.insertNode(node);
+        exprNodes.emplace_back(&e, node);
 
         // Condition
         auto condition = expStack.back();
         expStack.pop_back();
-        new ASTEdge(node, condition);
+        buffer.newEdge<ASTEdge>(node, condition);
 
         mc.BeginBlock(LabelType::Block, ife->true_);
-        BlockInst* trueBlock = new BlockInst(ife->true_);
-        graph.insertNode(trueBlock);
-        Node* beginTrueBlock = new BeginBlockInst(ife->true_.label, trueBlock);
-        graph.insertNode(beginTrueBlock);
-        new ASTEdge(node, trueBlock);
-        ifBlocks[&ife->true_] = beginTrueBlock;
+        Symbol label = buffer.intern(ife->true_.label);
+        BlockInst* trueBlock = buffer.newNode<BlockInst>(ife->true_, label);
+        buffer.setLocation(trueBlock, ife->true_.end_loc);
+        buffer.insertNode(trueBlock);
+        Node* beginTrueBlock = buffer.newNode<BeginBlockInst>(label, trueBlock);
+        buffer.insertNode(beginTrueBlock);
+        buffer.newEdge<ASTEdge>(node, trueBlock);
+        ifBlocks.emplace_back(&ife->true_, beginTrueBlock);
         construct(ife->true_.exprs, ife->true_.decl.GetNumResults(), trueBlock);
         if (!ife->false_.empty()) {
-            Node* elseBlock = new Else();
-            graph.insertNode(elseBlock);
-            new ASTEdge(node, elseBlock);
+            Node* elseBlock = buffer.newNode<Else>();
+            buffer.insertNode(elseBlock);
+            buffer.newEdge<ASTEdge>(node, elseBlock);
             construct(ife->false_, ife->true_.decl.GetNumResults(), elseBlock);
         }
         mc.EndBlock();
@@ -288,19 +394,23 @@ void AST::construct(const Expr& e,
         assert(false);
         return;
     }
-    graph.insertNode(node);
+    if (e.type() != ExprType::Block && e.type() != ExprType::Loop) {
+        // Blocks and loops record theirs before their children are built.
+        buffer.setLocation(node, e.loc);
+    }
+    buffer.insertNode(node);
     if (e.type() != ExprType::Block) {
         if (e.type() == ExprType::Return) {
-            exprNodes[&e] = returnFunc[currentFunction];
+            exprNodes.emplace_back(&e, returnNode);
         } else {
-            exprNodes[&e] = node;
+            exprNodes.emplace_back(&e, node);
         }
     }
     // Args
     for (Index i = 0; i < arity.nargs; i++) {
         auto arg = expStack.back();
         expStack.pop_back();
-        new ASTEdge(node, arg);
+        buffer.newEdge<ASTEdge>(node, arg);
     }
     // Return
     if (arity.nreturns == 0 || arity.unreachable) {
@@ -310,20 +420,18 @@ void AST::construct(const Expr& e,
     }
 }
 
-void AST::construct(const ExprList& es,
-                    Index nresults,
-                    Node* holder,
-                    Func* function) {
+void FunctionAST::construct(const ExprList& es,
+                            Index nresults,
+                            Node* holder,
+                            bool isBody) {
     assert(holder != nullptr);
     std::vector<Node*> expStack;
     std::vector<Node*> expList;
 
-    if (function != nullptr) {
-        mc.BeginFunc(*function);
-        currentFunction = function;
-        auto ret = new ReturnInst();
-        returnFunc[function] = ret;
-        graph.insertNode(ret);
+    if (isBody) {
+        mc.BeginFunc(*f);
+        returnNode = buffer.newNode<ReturnInst>();
+        buffer.insertNode(returnNode);
     }
 
     for (auto& e : es) {
@@ -331,41 +439,37 @@ void AST::construct(const ExprList& es,
     }
 
     for (auto& node : expList) {
-        new ASTEdge(holder, node);
+        buffer.newEdge<ASTEdge>(holder, node);
     }
 
     if (es.rbegin() != es.rend() &&
         es.rbegin()->type() == ExprType::Unreachable &&
         expStack.size() < nresults) {
         while (expStack.size() > 0) {
-            new ASTEdge(holder, expStack.back());
+            buffer.newEdge<ASTEdge>(holder, expStack.back());
             expStack.pop_back();
         }
-        if (function != nullptr) {
-            auto ret = returnFunc[function];
-            new ASTEdge(holder, ret);
+        if (isBody) {
+            buffer.newEdge<ASTEdge>(holder, returnNode);
             mc.EndFunc();
-            currentFunction = nullptr;
         }
         return;
     }
     warning(expStack.size() >= nresults);
-    if (function != nullptr) {
-        auto ret = returnFunc[function];
+    if (isBody) {
         if (nresults == 1) {
-            new ASTEdge(ret, expStack.back());
+            buffer.newEdge<ASTEdge>(returnNode, expStack.back());
             expStack.pop_back();
         }
         while (expStack.size() > 0) {
-            new ASTEdge(holder, expStack.back());
+            buffer.newEdge<ASTEdge>(holder, expStack.back());
             expStack.pop_back();
         }
-        new ASTEdge(holder, ret);
+        buffer.newEdge<ASTEdge>(holder, returnNode);
         mc.EndFunc();
-        currentFunction = nullptr;
     } else {
         for (auto node : expStack) {
-            new ASTEdge(holder, node);
+            buffer.newEdge<ASTEdge>(holder, node);
         }
     }
 }
@@ -6,38 +6,84 @@
 #include "src/generate-names.h"
 #include "src/ir-util.h"
 #include "src/ir.h"
+#include "src/memory-usage.h"
 #include "src/options.h"
+#include "src/pointer-map.h"
 
-#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 using namespace wabt;
 
 namespace wasmati {
+/// Builds the subtree of one function into a GraphBuffer. It only reads the
+/// module, so the functions of a module can be built on different threads.
+struct FunctionAST {
+    ModuleContext mc;
+    GraphBuffer buffer;
+    Func* const f;
+    const Index index;
+    Function* func = nullptr;
+    Node* returnNode = nullptr;
+    std::vector<std::pair<const Expr*, Node*>> exprNodes;
+    std::vector<std::pair<const Block*, Node*>> ifBlocks;
+
+    FunctionAST(const wabt::Module& module,
+                Arena<Node>& arena,
+                Func* f,
+                Index index)
+        : mc(module), buffer(arena), f(f), index(index) {}
+
+    void build();
+    void getLocalsNames(std::vector<std::string>& names) const;
+
+    void construct(const Expr& e,
+                   std::vector<Node*>& expStack,
+                   std::vector<Node*>& expList);
+
+    void construct(const ExprList& es,
+                   Index nresults,
+                   Node* holder,
+                   bool isBody = false);
+};
+
 struct AST {
     ModuleContext& mc;
     Graph& graph;
 
-    std::map<const Expr*, Node*> exprNodes;
-    std::map<const Block*, Node*> ifBlocks;
-    std::map<const Func*, Node*> returnFunc;
-    std::map<const Func*, Node*> funcs;
-    std::map<const std::string, Node*> funcsByName;
-    Func* currentFunction = nullptr;
+    /// Node of every expression, looked up by the CFG builder once per
+    /// expression, hence hash tables rather than trees.
+    PointerMap<Expr, Node*> exprNodes;
+    PointerMap<Block, Node*> ifBlocks;
+    PointerMap<Func, Node*> returnFunc;
+    PointerMap<Func, Node*> funcs;
+    std::unordered_map<std::string, Node*> funcsByName;
 
     AST(ModuleContext& mc, Graph& graph) : mc(mc), graph(graph) {}
 
     ~AST() {}
 
+    /// Builds the AST of the module. With cpgOptions.threads above one the
+    /// functions are built concurrently, then merged in module order, so the
+    /// graph is the same as with a single thread.
     void generateAST();
-    void getLocalsNames(Func* f, std::vector<std::string>& names) const;
+    /// Builds the AST one function at a time, as generateAST does with a
+    /// single thread: beginAST, generateFunction for every function, then
+    /// endAST once all of them are in the graph.
+    void beginAST();
+    void generateFunction(Func* f, Index index);
+    void endAST();
+    /// Frees the body of f from the module and forgets the nodes of its
+    /// expressions. Only valid when the maps hold no other function, the
+    /// graph is all that is left of the body afterwards.
+    void releaseBody(Func* f);
+    /// Bytes held by the maps from the IR to the graph.
+    size_t getMemoryUsage() const;
 
-    void construct(const Expr& e,
-                   std::vector<Node*>& expStack,
-                   std::vector<Node*>& expList);
+private:
+    Arena<Node> _arena;
 
-    void construct(const ExprList& es,
-                   Index nresults,
-                   Node* holder,
-                   Func* function = nullptr);
+    void merge(Module* m, FunctionAST& function);
 };
 
 }  // namespace wasmati
@@ -1,78 +1,239 @@
 #include "cfg-builder.h"
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
 namespace wasmati {
 void CFG::generateCFG() {
-    // Precalculate sig types for call_indirect
-    std::set<const Func*> funcsInTable;
+    std::vector<std::pair<Func*, Index>> todo;
+    Index func_index = 0;
+    for (auto f : mc.module.funcs) {
+        if ((cpgOptions.funcName.empty() ||
+             cpgOptions.funcName.compare(f->name) == 0) &&
+            !mc.module.IsImport(ExternalKind::Func, Var(func_index))) {
+            todo.emplace_back(f, func_index);
+        }
+        func_index++;
+    }
+
+    size_t numThreads = std::min<size_t>(cpgOptions.threads, todo.size());
+    if (numThreads <= 1) {
+        for (auto const& kv : todo) {
+            FunctionCFG function(ast, _arena, kv.first, kv.second);
+            function.build();
+            merge(function);
+        }
+        generateCalls();
+        return;
+    }
+
+    // As for the AST, every thread builds the next function left in an
+    // arena of its own, the functions are merged in module order.
+    std::vector<std::unique_ptr<Arena<Node>>> arenas;
+    std::vector<std::unique_ptr<FunctionCFG>> functions(todo.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < numThreads; t++) {
+        arenas.emplace_back(new Arena<Node>());
+        Arena<Node>* arena = arenas.back().get();
+        workers.emplace_back([&, arena]() {
+            for (size_t i = next++; i < todo.size(); i = next++) {
+                functions[i].reset(new FunctionCFG(ast, *arena, todo[i].first,
+                                                   todo[i].second));
+                functions[i]->build();
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (auto& function : functions) {
+        merge(*function);
+        function.reset();
+    }
+    for (auto& arena : arenas) {
+        graph.adoptNodes(*arena);
+    }
+    generateCalls();
+}
+
+void CFG::generateFunction(Func* f, Index index) {
+    if (mc.module.IsImport(ExternalKind::Func, Var(index))) {
+        return;
+    }
+    // Merging now would number the nodes of the CFG, and the trap, before
+    // the AST of the functions after this one.
+    _pending.emplace_back(new FunctionCFG(ast, _arena, f, index));
+    _pending.back()->build();
+    _pending.back()->releaseScratch();
+}
+
+void CFG::merge(FunctionCFG& function) {
+    debug("[DEBUG][CFG][%u/%lu] Function %s\n", function.index,
+          mc.module.funcs.size(), function.f->name.c_str());
+    graph.merge(function.buffer);
+    _calls.insert(_calls.end(), function.calls.begin(), function.calls.end());
+    _indirectCalls.insert(_indirectCalls.end(),
+                          function.indirectCalls.begin(),
+                          function.indirectCalls.end());
+}
+
+void CFG::generateCalls() {
+    for (auto& function : _pending) {
+        merge(*function);
+        function.reset();
+    }
+    _pending.clear();
+    graph.adoptNodes(_arena);
+    auto start = std::chrono::high_resolution_clock::now();
+    // Precalculate the callees of call_indirect by table and type
     for (auto elems : mc.module.elem_segments) {
+        Index table = mc.module.GetTableIndex(elems->table_var);
         for (auto elem : elems->elem_exprs) {
-            if (elem.kind == ElemExprKind::RefFunc) {
-                const Func* func = mc.module.GetFunc(elem.var);
-                funcsInTable.insert(func);
+            if (elem.kind != ElemExprKind::RefFunc) {
+                continue;
             }
+            const Func* f = mc.module.GetFunc(elem.var);
+            if (!cpgOptions.funcName.empty() &&
+                cpgOptions.funcName.compare(f->name) != 0) {
+                continue;
+            }
+            assert(f->decl.has_func_type);
+            TableType key(table, mc.module.GetFuncTypeIndex(f->decl));
+            funcByType[key].insert(ast.funcs.at(f));
         }
     }
-    for (auto f : mc.module.funcs) {
-        if (!cpgOptions.funcName.empty() &&
-            cpgOptions.funcName.compare(f->name) != 0) {
-            continue;
-        }
-        assert(f->decl.has_func_type);
-        if (funcsInTable.count(f) == 1) {
-            funcByType[f->decl.type_var.name()].insert(ast.funcs[f]);
+
+    // CGEdge
+    for (Node* inst : _calls) {
+        auto callee = ast.funcsByName.find(inst->label());
+        if (callee != ast.funcsByName.end()) {
+            graph.newEdge<CGEdge>(inst, callee->second);
         }
     }
-    Index func_index = 0;
-    for (auto f : mc.module.funcs) {
-        debug("[DEBUG][CFG][%u/%lu] Function %s\n", func_index,
-              mc.module.funcs.size(), f->name.c_str());
-        if (!cpgOptions.funcName.empty() &&
-            cpgOptions.funcName.compare(f->name) != 0) {
-            func_index++;
-            continue;
-        }
-        auto isImport = mc.module.IsImport(ExternalKind::Func, Var(func_index));
-
-        if (!isImport) {
-            Node* returnFuncNode = ast.returnFunc.at(f);
-            NodeSet instNodeQuery = Query::BFS(
-                {returnFuncNode}, Predicate().type(NodeType::Instructions),
-                Query::ALL_EDGES, 1, true);
-            assert(instNodeQuery.size() == 1);
-
-            Node* insts = *instNodeQuery.begin();
-            if (f->exprs.empty()) {
-                new CFGEdge(insts, returnFuncNode);
+    if (cpgOptions.signatureHubs) {
+        // One hub per table and type that has callees, linked to them once.
+        std::map<TableType, Node*> hubs;
+        for (auto const& call : _indirectCalls) {
+            auto callees = funcByType.find(call.second);
+            if (callees == funcByType.end()) {
                 continue;
             }
-            new CFGEdge(insts, ast.exprNodes.at(&f->exprs.front()));
+            Node*& hub = hubs[call.second];
+            if (hub == nullptr) {
+                const std::string& type =
+                    mc.module.types[call.second.second]->name;
+                hub = graph.newNode<SignatureHub>(graph.intern(type),
+                                                  call.second.first);
+                graph.insertNode(hub);
+                for (Node* func : callees->second) {
+                    graph.newEdge<CGEdge>(hub, func);
+                }
+            }
+            graph.newEdge<CGEdge>(call.first, hub);
+        }
+    } else {
+        for (auto const& call : _indirectCalls) {
+            for (Node* func : funcByType[call.second]) {
+                graph.newEdge<CGEdge>(call.first, func);
+            }
+        }
+    }
+    _calls.clear();
+    _indirectCalls.clear();
 
-            auto unreachable = construct(f->exprs);
+    if (cpgOptions.info) {
+        auto end = std::chrono::high_resolution_clock::now();
+        totalTime +=
+            std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+                .count();
+    }
+}
 
-            // Connect return
-            if (!unreachable) {
-                insertEdgeFromLastExpr(f->exprs, returnFuncNode);
-            } else {
-                continue;
-            }
-            auto childlessReturn = Query::BFS(
-                {insts},
-                [](Node* node) {
-                    return node->outEdges(EdgeType::CFG).size() == 0 &&
-                           node->inEdges(EdgeType::CFG).size() > 0 &&
-                           node->type() == NodeType::Instruction &&
-                           node->instType() != InstType::Return;
-                },
-                Query::AST_EDGES);
-            for (Node* node : childlessReturn) {
-                new CFGEdge(node, returnFuncNode);
+size_t CFG::getMemoryUsage() const {
+    size_t result = memory::heapBytes(funcByType) + memory::heapBytes(_calls) +
+                    memory::heapBytes(_indirectCalls);
+    for (auto const& kv : funcByType) {
+        result += kv.second.heapBytes();
+    }
+    for (auto const& function : _pending) {
+        result += function->buffer.getMemoryUsage() +
+                  memory::heapBytes(function->calls) +
+                  memory::heapBytes(function->indirectCalls);
+    }
+    return result;
+}
+
+void FunctionCFG::build() {
+    // Workers have no QueryContext, so the AST is read from the buckets of
+    // the nodes instead of through Query. The return node of the function
+    // is a child of its Instructions node.
+    Node* returnFuncNode = ast.returnFunc.at(f);
+    EdgeRange parents = returnFuncNode->inEdges(EdgeType::AST);
+    assert(parents.size() == 1 &&
+           parents[0]->src()->type() == NodeType::Instructions);
+
+    Node* insts = parents[0]->src();
+    if (f->exprs.empty()) {
+        newEdge(insts, returnFuncNode);
+        return;
+    }
+    newEdge(insts, ast.exprNodes.at(&f->exprs.front()));
+
+    auto unreachable = construct(f->exprs);
+
+    // Connect return
+    if (unreachable) {
+        return;
+    }
+    insertEdgeFromLastExpr(f->exprs, returnFuncNode);
+    // Instructions of the body with no successor yet fall through to the
+    // return, linked in id order.
+    std::vector<Node*> childlessReturn;
+    std::vector<Node*> stack{insts};
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        for (Edge* e : node->outEdges(EdgeType::AST)) {
+            Node* child = e->dest();
+            if (_outCFG.count(child) == 0 && _inCFG.count(child) == 1 &&
+                child->type() == NodeType::Instruction &&
+                child->instType() != InstType::Return) {
+                childlessReturn.push_back(child);
             }
+            stack.push_back(child);
         }
+    }
+    std::sort(childlessReturn.begin(), childlessReturn.end(),
+              [](Node* a, Node* b) { return a->id() < b->id(); });
+    childlessReturn.erase(
+        std::unique(childlessReturn.begin(), childlessReturn.end()),
+        childlessReturn.end());
+    for (Node* node : childlessReturn) {
+        newEdge(node, returnFuncNode);
+    }
+}
 
-        func_index++;
+void FunctionCFG::releaseScratch() {
+    std::vector<std::pair<Node*, std::vector<Node*>*>>().swap(_blocks);
+    std::unordered_map<std::string, std::vector<Node*>>().swap(_labels);
+    _inCFG = PointerMap<Node, Index>();
+    _outCFG = PointerMap<Node, Index>();
+}
+
+void FunctionCFG::newEdge(Node* src, Node* dest, const std::string& label) {
+    if (label.empty()) {
+        buffer.newEdge<CFGEdge>(src, dest);
+    } else {
+        buffer.newEdge<CFGEdge>(src, dest, label);
     }
+    _outCFG[src]++;
+    _inCFG[dest]++;
 }
-bool CFG::construct(const ExprList& es) {
+
+bool FunctionCFG::construct(const ExprList& es) {
     for (auto it = es.begin(); it != es.end(); it++) {
         switch (it->type()) {
         case ExprType::Return: {
@@ -80,24 +241,23 @@ bool CFG::construct(const ExprList& es) {
         }
         case ExprType::Unreachable: {
             Node* inst = ast.exprNodes.at(&*it);
-            new CFGEdge(inst, graph.getTrap());
+            buffer.newTrapEdge(inst);
+            _outCFG[inst]++;
             return true;
         }
         case ExprType::Br: {
             auto expr = cast<BrExpr>(&*it);
             Node* inst = ast.exprNodes.at(expr);
-            std::string target = expr->var.name();
-            new CFGEdge(inst, getBlock(target));
+            newEdge(inst, getBlock(expr->var));
             return true;
         }
         case ExprType::BrIf: {
             auto expr = cast<BrIfExpr>(&*it);
             Node* inst = ast.exprNodes.at(expr);
-            std::string target = expr->var.name();
-            new CFGEdge(inst, getBlock(target), "true");
+            newEdge(inst, getBlock(expr->var), "true");
             // if it's not the last
             if (&*it != &es.back()) {
-                new CFGEdge(inst, ast.exprNodes.at(&*std::next(it)), "false");
+                newEdge(inst, ast.exprNodes.at(&*std::next(it)), "false");
             }
             break;
         }
@@ -105,11 +265,10 @@ bool CFG::construct(const ExprList& es) {
             auto expr = cast<BrTableExpr>(&*it);
             Node* inst = ast.exprNodes.at(expr);
             for (Index i = 0; i < expr->targets.size(); i++) {
-                const std::string target = expr->targets[i].name();
-                new CFGEdge(inst, getBlock(target), std::to_string(i));
+                newEdge(inst, getBlock(expr->targets[i]), std::to_string(i));
             }
 
-            new CFGEdge(inst, getBlock(expr->default_target.name()), "default");
+            newEdge(inst, getBlock(expr->default_target), "default");
             break;
         }
         case ExprType::Block: {
@@ -118,14 +277,14 @@ bool CFG::construct(const ExprList& es) {
             Node* blockInst = beginBlockInst->block();
 
             // Push Label
-            _blocks.emplace_front(expr->block.label, blockInst);
+            pushBlock(expr->block.label, blockInst);
 
             // In case the block is empty
             if (expr->block.exprs.empty()) {
-                new CFGEdge(beginBlockInst, blockInst);
+                newEdge(beginBlockInst, blockInst);
             } else {
                 auto& firstExpr = expr->block.exprs.front();
-                new CFGEdge(beginBlockInst, ast.exprNodes.at(&firstExpr));
+                newEdge(beginBlockInst, ast.exprNodes.at(&firstExpr));
             }
 
             // construct
@@ -135,18 +294,18 @@ bool CFG::construct(const ExprList& es) {
                 insertEdgeFromLastExpr(expr->block.exprs, blockInst);
             }
 
-            if (!blockInst->hasInEdgesOf(EdgeType::CFG)) {
-                _blocks.pop_front();
+            if (_inCFG.count(blockInst) == 0) {
+                popBlock();
                 return false;
             }
 
             // if it's not the last
             if (&*it != &es.back()) {
-                new CFGEdge(blockInst, ast.exprNodes.at(&*std::next(it)));
+                newEdge(blockInst, ast.exprNodes.at(&*std::next(it)));
             }
 
             // Pop label
-            _blocks.pop_front();
+            popBlock();
             break;
         }
         case ExprType::Loop: {
@@ -154,17 +313,17 @@ bool CFG::construct(const ExprList& es) {
             Node* inst = ast.exprNodes.at(expr);
 
             // Push Label
-            _blocks.emplace_front(expr->block.label, inst);
+            pushBlock(expr->block.label, inst);
 
             // In case the loop is empty
             if (expr->block.exprs.empty()) {
                 // if it's not the last
                 if (&*it != &es.back()) {
-                    new CFGEdge(inst, ast.exprNodes.at(&*std::next(it)));
+                    newEdge(inst, ast.exprNodes.at(&*std::next(it)));
                 }
             } else {
                 auto& firstExpr = expr->block.exprs.front();
-                new CFGEdge(inst, ast.exprNodes.at(&firstExpr));
+                newEdge(inst, ast.exprNodes.at(&firstExpr));
             }
 
             // construct
@@ -172,15 +331,15 @@ bool CFG::construct(const ExprList& es) {
 
             // if it's not the last
             if (&*it != &es.back()) {
-                Node* endLoop =
-                    new EndLoopInst(inst->nresults(), inst->label());
-                graph.insertNode(endLoop);
+                Node* endLoop = buffer.newNode<EndLoopInst>(
+                    inst->nresults(), buffer.intern(inst->label()));
+                buffer.insertNode(endLoop);
                 insertEdgeFromLastExpr(expr->block.exprs, endLoop);
-                new CFGEdge(endLoop, ast.exprNodes.at(&*std::next(it)));
+                newEdge(endLoop, ast.exprNodes.at(&*std::next(it)));
             }
 
             // Pop label
-            _blocks.pop_front();
+            popBlock();
             break;
         }
         case ExprType::If: {
@@ -190,54 +349,55 @@ bool CFG::construct(const ExprList& es) {
             // True Condition
             auto trueBeginInst = ast.ifBlocks.at(&expr->true_);
             auto trueBlockInst = trueBeginInst->block();
-            new CFGEdge(inst, trueBeginInst, "true");
+            newEdge(inst, trueBeginInst, "true");
 
-            _blocks.emplace_front(expr->true_.label, trueBlockInst);
+            pushBlock(expr->true_.label, trueBlockInst);
             auto unreachable = construct(expr->true_.exprs);
             if (!expr->true_.exprs.empty()) {
-                new CFGEdge(trueBeginInst,
-                            ast.exprNodes.at(&expr->true_.exprs.front()));
+                newEdge(trueBeginInst,
+                        ast.exprNodes.at(&expr->true_.exprs.front()));
             }
             if (!unreachable) {
                 insertEdgeFromLastExpr(expr->true_.exprs, trueBlockInst);
             }
-            _blocks.pop_front();
+            popBlock();
 
             // False Condition
             if (!expr->false_.empty()) {
                 // In the Else "block" is the same block of the true
                 // so we need to put the true block in the stack in case there
                 // is a br
-                _blocks.emplace_front(expr->true_.label, trueBlockInst);
+                pushBlock(expr->true_.label, trueBlockInst);
                 // Visit False Block
                 auto fUnreachable = construct(expr->false_);
-                auto falseBeginInst = new BeginBlockInst(
-                    expr->true_.label, static_cast<BlockInst*>(trueBlockInst));
-                graph.insertNode(falseBeginInst);
-                new CFGEdge(inst, falseBeginInst, "false");
-                new CFGEdge(falseBeginInst,
-                            ast.exprNodes.at(&expr->false_.front()));
+                auto falseBeginInst = buffer.newNode<BeginBlockInst>(
+                    buffer.intern(trueBlockInst->label()),
+                    static_cast<BlockInst*>(trueBlockInst));
+                buffer.insertNode(falseBeginInst);
+                newEdge(inst, falseBeginInst, "false");
+                newEdge(falseBeginInst,
+                        ast.exprNodes.at(&expr->false_.front()));
                 if (!fUnreachable) {
                     insertEdgeFromLastExpr(expr->false_, trueBlockInst);
                 }
                 // Pop block
-                _blocks.pop_front();
+                popBlock();
                 if (unreachable && fUnreachable) {
                     return true;
                 }
             } else {
-                auto falseBeginInst = new BeginBlockInst(
-                    expr->true_.label, static_cast<BlockInst*>(trueBlockInst));
-                graph.insertNode(falseBeginInst);
-                new CFGEdge(inst, falseBeginInst, "false");
-                new CFGEdge(falseBeginInst, trueBlockInst);
+                auto falseBeginInst = buffer.newNode<BeginBlockInst>(
+                    buffer.intern(trueBlockInst->label()),
+                    static_cast<BlockInst*>(trueBlockInst));
+                buffer.insertNode(falseBeginInst);
+                newEdge(inst, falseBeginInst, "false");
+                newEdge(falseBeginInst, trueBlockInst);
             }
 
             // if it's not the last
             if (&*it != &es.back()) {
-                if (trueBlockInst->hasInEdgesOf(EdgeType::CFG)) {
-                    new CFGEdge(trueBlockInst,
-                                ast.exprNodes.at(&*std::next(it)));
+                if (_inCFG.count(trueBlockInst) == 1) {
+                    newEdge(trueBlockInst, ast.exprNodes.at(&*std::next(it)));
                 }
             }
             break;
@@ -246,59 +406,37 @@ bool CFG::construct(const ExprList& es) {
             Node* inst = ast.exprNodes.at(&*it);
             // if it's not the last
             if (&*it != &es.back()) {
-                new CFGEdge(inst, ast.exprNodes.at(&*std::next(it)));
-            }
-
-            auto start = std::chrono::high_resolution_clock::now();
-            // CGEdge
-            if (ast.funcsByName.count(inst->label()) == 1) {
-                new CGEdge(inst, ast.funcsByName[inst->label()]);
-            }
-            if (cpgOptions.info) {
-                auto end = std::chrono::high_resolution_clock::now();
-                auto time =
-                    std::chrono::duration_cast<std::chrono::milliseconds>(end -
-                                                                          start)
-                        .count();
-                totalTime += time;
+                newEdge(inst, ast.exprNodes.at(&*std::next(it)));
             }
+            // The callee may not be in the graph yet, see generateCalls
+            calls.push_back(inst);
             break;
         }
         case ExprType::CallIndirect: {
             Node* inst = ast.exprNodes.at(&*it);
             // if it's not the last
             if (&*it != &es.back()) {
-                new CFGEdge(inst, ast.exprNodes.at(&*std::next(it)));
+                newEdge(inst, ast.exprNodes.at(&*std::next(it)));
             }
-
-            auto start = std::chrono::high_resolution_clock::now();
-            // insert CG
             auto expr = cast<CallIndirectExpr>(&*it);
-            for (Node* func : funcByType[expr->decl.type_var.name()]) {
-                new CGEdge(inst, func);
-            }
-            if (cpgOptions.info) {
-                auto end = std::chrono::high_resolution_clock::now();
-                auto time =
-                    std::chrono::duration_cast<std::chrono::milliseconds>(end -
-                                                                          start)
-                        .count();
-                totalTime += time;
-            }
+            const wabt::Module& module = ast.mc.module;
+            indirectCalls.emplace_back(
+                inst, TableType(module.GetTableIndex(expr->table),
+                                module.GetFuncTypeIndex(expr->decl)));
             break;
         }
         default:
             Node* inst = ast.exprNodes.at(&*it);
             // if it's not the last
             if (&*it != &es.back()) {
-                new CFGEdge(inst, ast.exprNodes.at(&*std::next(it)));
+                newEdge(inst, ast.exprNodes.at(&*std::next(it)));
             }
         }
     }
     return false;
 }
-void CFG::insertEdgeFromLastExpr(const wabt::ExprList& es,
-                                 wasmati::Node* blockInst) {
+void FunctionCFG::insertEdgeFromLastExpr(const wabt::ExprList& es,
+                                         wasmati::Node* blockInst) {
     // Edge cases for last instruction:
     // In case of a Br || BrTable || Loop || return || unreachable: Do nothing
     // In case of a BrIf: Handle false case to this block.
@@ -317,24 +455,36 @@ void CFG::insertEdgeFromLastExpr(const wabt::ExprList& es,
         auto loop = cast<LoopExpr>(&lastExpr);
         insertEdgeFromLastExpr(loop->block.exprs, blockInst);
     } else if (lastExpr.type() == ExprType::BrIf) {
-        new CFGEdge(ast.exprNodes.at(&lastExpr), blockInst, "false");
+        newEdge(ast.exprNodes.at(&lastExpr), blockInst, "false");
     } else if (lastExpr.type() == ExprType::Block) {
         auto lastBlockInst = ast.exprNodes.at(&lastExpr)->block();
-        new CFGEdge(lastBlockInst, blockInst);
+        newEdge(lastBlockInst, blockInst);
     } else if (lastExpr.type() == ExprType::If) {
         auto ifExpr = cast<IfExpr>(&lastExpr);
-        new CFGEdge(ast.ifBlocks.at(&ifExpr->true_)->block(), blockInst);
+        newEdge(ast.ifBlocks.at(&ifExpr->true_)->block(), blockInst);
     } else {
-        new CFGEdge(ast.exprNodes.at(&lastExpr), blockInst);
+        newEdge(ast.exprNodes.at(&lastExpr), blockInst);
     }
 }
-Node* CFG::getBlock(const std::string& target) {
-    for (auto p : _blocks) {
-        if (target.compare(p.first) == 0) {
-            return p.second;
-        }
+void FunctionCFG::pushBlock(const std::string& label, Node* block) {
+    std::vector<Node*>* blocks = &_labels[label];
+    blocks->push_back(block);
+    _blocks.emplace_back(block, blocks);
+}
+
+void FunctionCFG::popBlock() {
+    _blocks.back().second->pop_back();
+    _blocks.pop_back();
+}
+
+Node* FunctionCFG::getBlock(const Var& target) {
+    if (target.is_index()) {
+        // Relative depth, 0 is the innermost block
+        assert(target.index() < _blocks.size());
+        return _blocks[_blocks.size() - 1 - target.index()].first;
     }
-    assert(false);
-    return nullptr;
+    auto it = _labels.find(target.name());
+    assert(it != _labels.end() && !it->second.empty());
+    return it->second.back();
 }
 }  // namespace wasmati
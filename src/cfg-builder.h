@@ -1,7 +1,9 @@
 #ifndef WASMATI_CFG_BUILDER_H_
 #define WASMATI_CFG_BUILDER_H_
 
-#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include "ast-builder.h"
 #include "src/cast.h"
 #include "query.h"
@@ -9,12 +11,58 @@
 using namespace wabt;
 
 namespace wasmati {
+/// Table and function type indexes of a call_indirect, which select the
+/// functions it may call.
+typedef std::pair<Index, Index> TableType;
+
+/// Builds the CFG of one function into a GraphBuffer. It only reads the
+/// module and the graph, so the functions of a module can be built on
+/// different threads.
+struct FunctionCFG {
+    const AST& ast;
+    GraphBuffer buffer;
+    Func* const f;
+    const Index index;
+    // Enclosing blocks, innermost last, each with the blocks of its label.
+    // A label names the innermost block that has it.
+    std::vector<std::pair<Node*, std::vector<Node*>*>> _blocks;
+    std::unordered_map<std::string, std::vector<Node*>> _labels;
+    /// Calls of the function, linked to their callees by CFG::generateCalls.
+    std::vector<Node*> calls;
+    std::vector<std::pair<Node*, TableType>> indirectCalls;
+    // CFG edges recorded at every node, the graph does not have them yet.
+    PointerMap<Node, Index> _inCFG;
+    PointerMap<Node, Index> _outCFG;
+
+    FunctionCFG(const AST& ast, Arena<Node>& arena, Func* f, Index index)
+        : ast(ast), buffer(arena), f(f), index(index) {}
+
+    void build();
+    /// Frees what only build needs. The buffer and the calls are kept.
+    void releaseScratch();
+
+    /// @brief Constructs the CFG in the given expression list
+    /// @param es Expression list
+    bool construct(const ExprList& es);
+
+private:
+    void newEdge(Node* src, Node* dest, const std::string& label = "");
+    void pushBlock(const std::string& label, Node* block);
+    void popBlock();
+    void insertEdgeFromLastExpr(const wabt::ExprList& es,
+                                wasmati::Node* blockInst);
+    /// Block a branch goes to, by relative depth or by label.
+    Node* getBlock(const Var& target);
+};
+
 struct CFG {
     ModuleContext& mc;
     Graph& graph;
     AST& ast;
-    std::list<std::pair<std::string, Node*>> _blocks;
-    std::map<std::string, NodeSet> funcByType;
+    std::map<TableType, NodeSet> funcByType;
+    /// Calls seen so far, linked to their callees by generateCalls.
+    std::vector<Node*> _calls;
+    std::vector<std::pair<Node*, TableType>> _indirectCalls;
     unsigned long totalTime = 0;
 
     CFG(ModuleContext& mc, Graph& graph, AST& ast)
@@ -22,16 +70,27 @@ struct CFG {
 
     ~CFG() {}
 
+    /// Builds the CFG of the module. With cpgOptions.threads above one the
+    /// functions are built concurrently, then merged in module order, so the
+    /// graph is the same as with a single thread.
     void generateCFG();
-
-    /// @brief Constructs the CFG in the given expression list
-    /// @param es Expression list
-    bool construct(const ExprList& es);
+    /// Builds the CFG of one function, for --stream. Nothing is added to the
+    /// graph yet: the function is merged by generateCalls, after the AST of
+    /// every function, so the nodes get the same ids as with generateCFG.
+    void generateFunction(Func* f, Index index);
+    /// Merges the functions built by generateFunction, links the recorded
+    /// calls and hands the nodes made by the CFG over to the graph. Called
+    /// last.
+    void generateCalls();
+    /// Bytes held by the functions not merged yet, the recorded calls and
+    /// the call_indirect targets.
+    size_t getMemoryUsage() const;
 
 private:
-    void insertEdgeFromLastExpr(const wabt::ExprList& es,
-                                wasmati::Node* blockInst);
-    Node* getBlock(const std::string& expr);
+    Arena<Node> _arena;
+    std::vector<std::unique_ptr<FunctionCFG>> _pending;
+
+    void merge(FunctionCFG& function);
 };
 
 }  // namespace wasmati
@@ -0,0 +1,269 @@
+#include "src/dominators.h"
+
+#include <algorithm>
+
+namespace wasmati {
+
+const Index DominatorTree::NONE;
+
+DominatorTree::DominatorTree(Node* function, bool post) : _post(post) {
+    assert(function->type() == NodeType::Function);
+    Node* start = nullptr;
+    for (Edge* e : function->outEdges(EdgeType::AST)) {
+        if (e->dest()->type() == NodeType::Instructions) {
+            start = e->dest();
+            break;
+        }
+    }
+    if (start == nullptr) {
+        // An imported function has no code.
+        return;
+    }
+
+    // Nodes of the CFG in the order they are found, by local number.
+    PointerMap<Node, Index> local;
+    std::vector<Node*> nodes = {start};
+    std::vector<std::vector<Index>> succs(1);
+    std::vector<std::vector<Index>> preds(1);
+    local[start] = 0;
+    for (Index i = 0; i < nodes.size(); i++) {
+        for (Edge* e : nodes[i]->outEdges(EdgeType::CFG)) {
+            Node* dest = e->dest();
+            if (dest->type() == NodeType::Trap) {
+                continue;
+            }
+            if (local.count(dest) == 0) {
+                local[dest] = static_cast<Index>(nodes.size());
+                nodes.push_back(dest);
+                succs.emplace_back();
+                preds.emplace_back();
+            }
+            Index j = local.at(dest);
+            succs[i].push_back(j);
+            preds[j].push_back(i);
+        }
+    }
+    Index root = 0;
+    if (post) {
+        // Post-dominators are the dominators of the reversed CFG, walked
+        // from a virtual exit that precedes every end of the function.
+        root = static_cast<Index>(nodes.size());
+        nodes.push_back(nullptr);
+        succs.emplace_back();
+        preds.emplace_back();
+        for (Index i = 0; i < root; i++) {
+            if (succs[i].empty()) {
+                succs[i].push_back(root);
+                preds[root].push_back(i);
+            }
+        }
+        succs.swap(preds);
+    }
+    const Index n = static_cast<Index>(nodes.size());
+
+    // Postorder of the nodes reached from the root.
+    std::vector<Index> postorder(n, NONE);
+    std::vector<Index> order;
+    std::vector<bool> seen(n, false);
+    std::vector<std::pair<Index, Index>> stack = {{root, 0}};
+    seen[root] = true;
+    while (!stack.empty()) {
+        Index v = stack.back().first;
+        if (stack.back().second == succs[v].size()) {
+            postorder[v] = static_cast<Index>(order.size());
+            order.push_back(v);
+            stack.pop_back();
+            continue;
+        }
+        Index w = succs[v][stack.back().second++];
+        if (!seen[w]) {
+            seen[w] = true;
+            stack.emplace_back(w, 0);
+        }
+    }
+
+    // Cooper, Harvey and Kennedy: refine the immediate dominators in reverse
+    // postorder until they settle. Two dominators are intersected by walking
+    // both up the tree built so far until they meet.
+    std::vector<Index> idom(n, NONE);
+    idom[root] = root;
+    auto intersect = [&](Index a, Index b) {
+        while (a != b) {
+            while (postorder[a] < postorder[b]) {
+                a = idom[a];
+            }
+            while (postorder[b] < postorder[a]) {
+                b = idom[b];
+            }
+        }
+        return a;
+    };
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        // The root is last in postorder.
+        for (size_t k = order.size() - 1; k-- > 0;) {
+            Index v = order[k];
+            Index dom = NONE;
+            for (Index p : preds[v]) {
+                if (idom[p] == NONE) {
+                    continue;
+                }
+                dom = dom == NONE ? p : intersect(p, dom);
+            }
+            if (idom[v] != dom) {
+                idom[v] = dom;
+                changed = true;
+            }
+        }
+    }
+
+    // Pre-order numbering of the tree.
+    std::vector<std::vector<Index>> children(n);
+    for (Index v : order) {
+        if (v != root) {
+            children[idom[v]].push_back(v);
+        }
+    }
+    std::vector<Index> pre(n, NONE);
+    _nodes.reserve(order.size());
+    _idom.reserve(order.size());
+    _last.reserve(order.size());
+    pre[root] = 0;
+    _nodes.push_back(nodes[root]);
+    _idom.push_back(NONE);
+    _last.push_back(NONE);
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+        Index v = stack.back().first;
+        if (stack.back().second == children[v].size()) {
+            _last[pre[v]] = static_cast<Index>(_nodes.size() - 1);
+            stack.pop_back();
+            continue;
+        }
+        Index w = children[v][stack.back().second++];
+        pre[w] = static_cast<Index>(_nodes.size());
+        _nodes.push_back(nodes[w]);
+        _idom.push_back(pre[v]);
+        _last.push_back(NONE);
+        stack.emplace_back(w, 0);
+    }
+    _pre.reserve(_nodes.size());
+    for (Index i = 0; i < _nodes.size(); i++) {
+        if (_nodes[i] != nullptr) {
+            _pre[_nodes[i]] = i;
+        }
+    }
+}
+
+size_t DominatorTree::getMemoryUsage() const {
+    size_t result = sizeof(*this) + _pre.heapBytes();
+    result += _nodes.capacity() * sizeof(Node*);
+    result += (_last.capacity() + _idom.capacity()) * sizeof(Index);
+    return result;
+}
+
+const Index LoopForest::NONE;
+
+LoopForest::LoopForest(Node* function) {
+    // Loops are numbered in pre-order of the AST, so a loop comes before
+    // the loops inside it and the loops inside it follow one another.
+    std::vector<Node*> headers;
+    std::vector<Index> parents;
+    std::vector<std::vector<Node*>> own;
+    PointerMap<Node, Index> loopOf;
+    std::vector<std::pair<Node*, Index>> stack;
+    stack.emplace_back(function, NONE);
+    while (!stack.empty()) {
+        Node* node = stack.back().first;
+        Index loop = stack.back().second;
+        stack.pop_back();
+        if (node->type() == NodeType::Instruction &&
+            node->instType() == InstType::Loop) {
+            headers.push_back(node);
+            parents.push_back(loop);
+            own.emplace_back();
+            loop = static_cast<Index>(headers.size() - 1);
+        }
+        if (loop != NONE) {
+            own[loop].push_back(node);
+            loopOf[node] = loop;
+        }
+        auto children = node->outEdges(EdgeType::AST);
+        for (Index i = static_cast<Index>(children.size()); i-- > 0;) {
+            stack.emplace_back(children[i]->dest(), loop);
+        }
+    }
+    const Index numLoops = static_cast<Index>(headers.size());
+
+    // The nodes the CFG adds have no AST parent and lead to one node. Those
+    // leading to a loop instruction come before the loop, they belong to
+    // the enclosing one. Inner loops go first, so a node added to the
+    // enclosing loop still has its predecessors looked at.
+    for (Index loop = numLoops; loop-- > 0;) {
+        for (Index i = 0; i < own[loop].size(); i++) {
+            Index target = i == 0 ? parents[loop] : loop;
+            if (target == NONE) {
+                continue;
+            }
+            for (Edge* e : own[loop][i]->inEdges(EdgeType::CFG)) {
+                Node* src = e->src();
+                if (src->type() == NodeType::Instruction &&
+                    src->inEdges(EdgeType::AST).empty() &&
+                    src->outEdges(EdgeType::CFG).size() == 1 &&
+                    loopOf.count(src) == 0) {
+                    own[target].push_back(src);
+                    loopOf[src] = target;
+                }
+            }
+        }
+    }
+
+    // In pre-order the own nodes of a loop and of the loops inside it come
+    // one after the other.
+    _loops.reserve(numLoops);
+    for (Index loop = 0; loop < numLoops; loop++) {
+        Index parent = parents[loop];
+        _loops.push_back(Loop{headers[loop], parent,
+                              parent == NONE ? 1 : _loops[parent].depth + 1,
+                              static_cast<Index>(_order.size()), 0, {}});
+        for (Node* node : own[loop]) {
+            _order.push_back(node);
+            _loopOf.push_back(loop);
+        }
+        _loops[loop].end = static_cast<Index>(_order.size());
+    }
+    for (Index loop = numLoops; loop-- > 0;) {
+        Index parent = _loops[loop].parent;
+        if (parent != NONE) {
+            _loops[parent].end = std::max(_loops[parent].end, _loops[loop].end);
+        }
+    }
+    _position.reserve(_order.size());
+    for (Index i = 0; i < _order.size(); i++) {
+        _position[_order[i]] = i;
+    }
+
+    for (Index loop = 0; loop < _loops.size(); loop++) {
+        for (Node* node : body(loop)) {
+            for (Edge* e : node->outEdges(EdgeType::CFG)) {
+                if (!isWithin(e->dest(), loop)) {
+                    _loops[loop].exits.push_back(e);
+                }
+            }
+        }
+    }
+}
+
+size_t LoopForest::getMemoryUsage() const {
+    size_t result = sizeof(*this) + _position.heapBytes();
+    result += _order.capacity() * sizeof(Node*);
+    result += _loopOf.capacity() * sizeof(Index);
+    result += _loops.capacity() * sizeof(Loop);
+    for (const Loop& loop : _loops) {
+        result += loop.exits.capacity() * sizeof(Edge*);
+    }
+    return result;
+}
+
+}  // namespace wasmati
@@ -0,0 +1,137 @@
+#ifndef WASMATI_DOMINATORS_H
+#define WASMATI_DOMINATORS_H
+#include <vector>
+#include "src/graph.h"
+#include "src/pointer-map.h"
+
+namespace wasmati {
+
+/// Dominator tree of the CFG of one function, or its post-dominator tree.
+/// The CFG starts at the Instructions node of the function and every node
+/// without a CFG successor ends it. Edges to the trap are left out, so an
+/// instruction that can only trap ends the function like a return does.
+///
+/// The tree is numbered in pre-order like ASTIntervals, so whether a node
+/// dominates another is two comparisons. Nodes the start of the function
+/// does not reach, and for the post-dominators the nodes that never reach an
+/// end, are not in the tree.
+class DominatorTree {
+    static const Index NONE = ~0u;
+
+    // Pre-order number of every node of the tree.
+    PointerMap<Node, Index> _pre;
+    // By pre-order number. The post-dominator tree is rooted at a virtual
+    // exit that is every end of the function, its node is null.
+    std::vector<Node*> _nodes;
+    std::vector<Index> _last;
+    std::vector<Index> _idom;
+    bool _post;
+
+public:
+    /// Computed with the iterative algorithm of Cooper, Harvey and Kennedy.
+    DominatorTree(Node* function, bool post);
+
+    inline bool isPost() const { return _post; }
+    inline bool contains(const Node* node) const {
+        return _pre.count(node) == 1;
+    }
+    /// Nodes of the tree in pre-order. The virtual exit of a post-dominator
+    /// tree comes first and is null.
+    inline NodeRange nodes() const {
+        return NodeRange(_nodes.data(), _nodes.data() + _nodes.size());
+    }
+    /// Position of node in nodes().
+    inline Index position(const Node* node) const {
+        assert(contains(node));
+        return _pre.at(node);
+    }
+    /// Whether every path from the start of the function to b goes through
+    /// a, or for the post-dominators every path from b to an end. A node
+    /// dominates itself.
+    inline bool dominates(const Node* a, const Node* b) const {
+        assert(contains(a) && contains(b));
+        Index pre = _pre.at(b);
+        return _pre.at(a) <= pre && pre <= _last[_pre.at(a)];
+    }
+    /// Parent of node in the tree, null for the root and, in the
+    /// post-dominator tree, for the ends of the function.
+    inline Node* idom(const Node* node) const {
+        assert(contains(node));
+        Index parent = _idom[_pre.at(node)];
+        return parent == NONE ? nullptr : _nodes[parent];
+    }
+
+    size_t getMemoryUsage() const;
+};
+
+/// Loops of one function, nested into a forest. Every loop instruction
+/// heads a loop, whether or not something branches back to it. Its body is
+/// the loop instruction, the instructions below it in the AST, and the
+/// nodes the CFG adds among them, such as begin blocks and the ends of the
+/// loops inside it. A node the CFG adds belongs to the loops of the node it
+/// leads to.
+///
+/// The nodes in loops are laid out so that the body of every loop, inner
+/// loops included, is a contiguous range, like the descendants in
+/// ASTIntervals. Whether a node is in a loop is then two comparisons.
+class LoopForest {
+public:
+    static const Index NONE = ~0u;
+
+    struct Loop {
+        Node* header;
+        /// Enclosing loop, NONE for an outermost one.
+        Index parent;
+        /// One for an outermost loop.
+        Index depth;
+        Index begin;
+        Index end;
+        /// CFG edges from the body to a node out of the loop.
+        std::vector<Edge*> exits;
+    };
+
+private:
+    // Position of every node in a loop, and by position the node and its
+    // innermost loop.
+    PointerMap<Node, Index> _position;
+    std::vector<Node*> _order;
+    std::vector<Index> _loopOf;
+    // Outer loops before the loops they enclose.
+    std::vector<Loop> _loops;
+
+public:
+    /// Walks the AST below function once and the CFG edges of its loops.
+    explicit LoopForest(Node* function);
+
+    inline const std::vector<Loop>& loops() const { return _loops; }
+    /// Innermost loop the node is in, NONE if it is in no loop.
+    inline Index loopOf(const Node* node) const {
+        return _position.count(node) == 1 ? _loopOf[_position.at(node)]
+                                          : NONE;
+    }
+    /// Whether node is in the body of loop or of a loop inside it.
+    inline bool isWithin(const Node* node, Index loop) const {
+        if (_position.count(node) == 0) {
+            return false;
+        }
+        Index position = _position.at(node);
+        return _loops[loop].begin <= position && position < _loops[loop].end;
+    }
+    /// Nodes of loop, its header first.
+    inline NodeRange body(Index loop) const {
+        Node* const* order = _order.data();
+        return NodeRange(order + _loops[loop].begin,
+                         order + _loops[loop].end);
+    }
+    /// Number of loops the node is in.
+    inline Index depth(const Node* node) const {
+        Index loop = loopOf(node);
+        return loop == NONE ? 0 : _loops[loop].depth;
+    }
+
+    size_t getMemoryUsage() const;
+};
+
+}  // namespace wasmati
+
+#endif /* WASMATI_DOMINATORS_H */
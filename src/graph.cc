@@ -1,5 +1,9 @@
 #include "src/graph.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
 namespace wasmati {
 
 const char functionSignatureName[] = "FunctionSignature";
@@ -11,8 +15,6 @@ const char elseName[] = "Else";
 const char trapName[] = "Trap";
 const char startName[] = "Start";
 
-Index Node::idCount = 0;
-
 const std::map<NodeType, std::string> NODE_TYPE_MAP = {
 #define WASMATI_ENUMS_NODE_TYPE(type, name) {type, name},
 #include "src/config/enums.def"
@@ -61,50 +63,70 @@ const std::map<std::string, PDGType> PDG_TYPE_MAP_R = {
 #undef WASMATI_ENUMS_PDG_EDGE_TYPE
 };
 
-Node::~Node() {
-    for (auto e : _outEdges) {
-        delete e;
+void EdgeBuckets::insert(Edge* e, EdgeType type) {
+    unsigned bucket = static_cast<unsigned>(type);
+    assert(bucket < NUM_BUCKETS);
+    uint32_t size = _ends[NUM_BUCKETS - 1];
+    if (size == _capacity) {
+        _capacity = _capacity == 0 ? 2 : 2 * _capacity;
+        _edges = static_cast<Edge**>(
+            std::realloc(_edges, _capacity * sizeof(Edge*)));
+        if (_edges == nullptr) {
+            throw std::bad_alloc();
+        }
+    }
+    // Edges mostly arrive type by type and towards increasing ids, so the
+    // slot is usually at the end and little has to be shifted.
+    Index key = neighbourId(e);
+    uint32_t begin = bucket == 0 ? 0 : _ends[bucket - 1];
+    uint32_t pos = _ends[bucket];
+    while (pos > begin && neighbourId(_edges[pos - 1]) > key) {
+        pos--;
+    }
+    std::memmove(_edges + pos + 1, _edges + pos, (size - pos) * sizeof(Edge*));
+    _edges[pos] = e;
+    for (unsigned i = bucket; i < NUM_BUCKETS; i++) {
+        _ends[i]++;
     }
 }
 
-EdgeSet Node::inEdges(EdgeType type) {
-    EdgeSet res;
-    for (auto e : _inEdges) {
-        if (e->type() == type) {
-            res.insert(e);
-        }
-    }
-    return res;
+Symbol Node::intern(const std::string& str) const {
+    assert(_graph != nullptr);
+    return _graph->intern(str);
 }
 
-EdgeSet Node::outEdges(EdgeType type) {
-    EdgeSet res;
-    for (auto e : _outEdges) {
-        if (e->type() == type) {
-            res.insert(e);
-        }
-    }
-    return res;
+const std::string& Node::symbolString(Symbol symbol) const {
+    assert(_graph != nullptr);
+    return _graph->strings().str(symbol);
+}
+
+Index Node::internConstant(const Const& value) const {
+    assert(_graph != nullptr);
+    return _graph->internConstant(value);
+}
+
+Location Node::location() const {
+    return _graph != nullptr ? _graph->location(this) : Location();
+}
+
+Index EdgeBuckets::neighbourId(const Edge* e) const {
+    return _incoming ? e->src()->id() : e->dest()->id();
+}
+
+void Node::addInEdge(Edge* e) {
+    _inEdges.insert(e, e->type());
+}
+
+void Node::addOutEdge(Edge* e) {
+    _outEdges.insert(e, e->type());
 }
 
 inline Edge* Node::getOutEdge(Index i, EdgeType type) {
-    auto edges = outEdges(type);
-    assert(i < edges.size());
-    std::vector<Edge*> vec(edges.begin(), edges.end());
-    std::sort(vec.begin(), vec.end(), [](Edge* a, Edge* b) {
-        return a->dest()->id() < b->dest()->id();
-    });
-    return vec[i];
+    return outEdges(type)[i];
 }
 
 inline Edge* Node::getInEdge(Index i, EdgeType type) {
-    auto edges = inEdges(type);
-    assert(i < edges.size());
-    std::vector<Edge*> vec(edges.begin(), edges.end());
-    std::sort(vec.begin(), vec.end(),
-              [](Edge* a, Edge* b) { return a->src()->id() < b->src()->id(); });
-
-    return vec[i];
+    return inEdges(type)[i];
 }
 
 Node* Node::getChild(Index n, EdgeType type) {
@@ -120,21 +142,11 @@ bool Node::hasEdgesOf(EdgeType type) const {
 }
 
 bool Node::hasInEdgesOf(EdgeType type) const {
-    for (auto e : _inEdges) {
-        if (e->type() == type) {
-            return true;
-        }
-    }
-    return false;
+    return !inEdges(type).empty();
 }
 
 bool Node::hasOutEdgesOf(EdgeType type) const {
-    for (auto e : _outEdges) {
-        if (e->type() == type) {
-            return true;
-        }
-    }
-    return false;
+    return !outEdges(type).empty();
 }
 
 void Node::accept(GraphVisitor* visitor) {
@@ -142,7 +154,8 @@ void Node::accept(GraphVisitor* visitor) {
 }
 
 void Node::acceptEdges(GraphVisitor* visitor) {
-    for (Edge* e : _outEdges) {
+    complete();
+    for (Edge* e : _outEdges.all()) {
         e->accept(visitor);
     }
 }
@@ -153,6 +166,9 @@ void Module::accept(GraphVisitor* visitor) {
 void Function::accept(GraphVisitor* visitor) {
     visitor->visitFunction(this);
 }
+void SignatureHub::accept(GraphVisitor* visitor) {
+    visitor->visitSignatureHub(this);
+}
 void VarNode::accept(GraphVisitor* visitor) {
     visitor->visitVarNode(this);
 }
@@ -165,26 +181,733 @@ void IfInst::accept(GraphVisitor* visitor) {
     visitor->visitIfInst(this);
 }
 
-void ASTEdge::accept(GraphVisitor* visitor) {
-    visitor->visitASTEdge(this);
+void Edge::accept(GraphVisitor* visitor) {
+    switch (type()) {
+    case EdgeType::AST:
+        visitor->visitASTEdge(static_cast<ASTEdge*>(this));
+        break;
+    case EdgeType::CFG:
+        visitor->visitCFGEdge(static_cast<CFGEdge*>(this));
+        break;
+    case EdgeType::PDG:
+        visitor->visitPDGEdge(static_cast<PDGEdge*>(this));
+        break;
+    case EdgeType::CG:
+        visitor->visitCGEdge(static_cast<CGEdge*>(this));
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+Symbol Edge::constLabel() const {
+    return _src->graph()->constants().label(_payload);
+}
+
+const Const& Edge::constValue() const {
+    return _src->graph()->constants().value(_payload);
 }
 
-void CFGEdge::accept(GraphVisitor* visitor) {
-    visitor->visitCFGEdge(this);
+ConstantPool::Key::Key(const Const& value) {
+    switch (value.type) {
+    case Type::I32:
+        type = 0;
+        bits = value.u32;
+        break;
+    case Type::I64:
+        type = 1;
+        bits = value.u64;
+        break;
+    case Type::F32:
+        type = 2;
+        bits = value.f32_bits;
+        break;
+    case Type::F64:
+        type = 3;
+        bits = value.f64_bits;
+        break;
+    default:
+        assert(false);
+        type = 4;
+        bits = 0;
+        break;
+    }
 }
 
-void PDGEdge::accept(GraphVisitor* visitor) {
-    visitor->visitPDGEdge(this);
+Index ConstantPool::intern(const Const& value, StringTable& strings) {
+    auto it = _index.find(Key(value));
+    if (it != _index.end()) {
+        return it->second;
+    }
+    Index i = static_cast<Index>(_values.size());
+    _values.push_back(value);
+    _labels.push_back(strings.intern(Utils::writeConst(value)));
+    _index.emplace(Key(value), i);
+    return i;
 }
 
-void CGEdge::accept(GraphVisitor* visitor) {
-    visitor->visitCGEdge(this);
+size_t ConstantPool::getMemoryUsage() const {
+    return memory::heapBytes(_values) + memory::heapBytes(_labels) +
+           memory::heapBytes(_index);
 }
 
 void BeginBlockInst::accept(GraphVisitor* visitor) {
     visitor->visitBeginBlockInst(this);
 }
 
+FrozenIndex::FrozenIndex(const std::vector<Node*>& nodes)
+    : _base(std::numeric_limits<Index>::max()) {
+    Index last = 0;
+    for (Node* node : nodes) {
+        _base = std::min(_base, node->id());
+        last = std::max(last, node->id());
+    }
+    if (nodes.empty()) {
+        _base = 0;
+        return;
+    }
+    _nodes.assign(last - _base + 1, nullptr);
+    for (Node* node : nodes) {
+        _nodes[node->id() - _base] = node;
+    }
+
+    const Index numRows = _nodes.size();
+    CompareEdge compare;
+    std::vector<Edge*> row;
+    for (unsigned t = 0; t < NUM_EDGE_TYPES; t++) {
+        EdgeType type = static_cast<EdgeType>(t);
+        CSRAdjacency& out = _out[t];
+        out.offsets.reserve(numRows + 1);
+        for (Node* node : _nodes) {
+            out.offsets.push_back(out.neighbours.size());
+            if (node == nullptr) {
+                continue;
+            }
+            auto edges = node->outEdges(type);
+            row.assign(edges.begin(), edges.end());
+            std::sort(row.begin(), row.end(), compare);
+            for (Edge* e : row) {
+                out.neighbours.push_back(e->dest()->id());
+                out.edges.push_back(_edges.size());
+                _edges.push_back(e);
+            }
+        }
+        out.offsets.push_back(out.neighbours.size());
+
+        // The reverse index is the transpose of the forward one. Walking the
+        // sources in id order leaves every row in EdgeSet order as well.
+        CSRAdjacency& in = _in[t];
+        in.offsets.assign(numRows + 1, 0);
+        for (Index dest : out.neighbours) {
+            in.offsets[dest - _base + 1]++;
+        }
+        for (Index r = 0; r < numRows; r++) {
+            in.offsets[r + 1] += in.offsets[r];
+        }
+        in.neighbours.resize(out.neighbours.size());
+        in.edges.resize(out.edges.size());
+        std::vector<Index> cursor(in.offsets.begin(), in.offsets.end() - 1);
+        for (Index r = 0; r < numRows; r++) {
+            for (Index i = out.begin(r); i < out.end(r); i++) {
+                Index pos = cursor[out.neighbours[i] - _base]++;
+                in.neighbours[pos] = _base + r;
+                in.edges[pos] = out.edges[i];
+            }
+        }
+    }
+}
+
+size_t FrozenIndex::getMemoryUsage() const {
+    size_t result = sizeof(*this);
+    result += _nodes.capacity() * sizeof(Node*);
+    result += _edges.capacity() * sizeof(Edge*);
+    for (unsigned t = 0; t < NUM_EDGE_TYPES; t++) {
+        for (const CSRAdjacency* csr : {&_out[t], &_in[t]}) {
+            result += (csr->offsets.capacity() + csr->neighbours.capacity() +
+                       csr->edges.capacity()) *
+                      sizeof(Index);
+        }
+    }
+    return result;
+}
+
+const Index BasicBlocks::NONE;
+
+BasicBlocks::BasicBlocks(const std::vector<Node*>& byId)
+    : _block(byId.size(), NONE), _position(byId.size(), NONE) {
+    auto hasCFG = [](Node* node) {
+        return !node->inEdges(EdgeType::CFG).empty() ||
+               !node->outEdges(EdgeType::CFG).empty();
+    };
+    // A node starts a block unless its only predecessor has it as its only
+    // successor.
+    auto leads = [](Node* node) {
+        auto in = node->inEdges(EdgeType::CFG);
+        return in.size() != 1 ||
+               in[0]->src()->outEdges(EdgeType::CFG).size() != 1;
+    };
+    auto grow = [&](Node* node) {
+        Index block = static_cast<Index>(_begin.size());
+        _begin.push_back(static_cast<Index>(_nodes.size()));
+        while (true) {
+            _block[node->id()] = block;
+            _position[node->id()] = static_cast<Index>(_nodes.size());
+            _nodes.push_back(node);
+            auto out = node->outEdges(EdgeType::CFG);
+            if (out.size() != 1) {
+                return;
+            }
+            node = out[0]->dest();
+            if (_block[node->id()] != NONE ||
+                node->inEdges(EdgeType::CFG).size() != 1) {
+                return;
+            }
+        }
+    };
+    for (Node* node : byId) {
+        if (node != nullptr && hasCFG(node) && leads(node)) {
+            grow(node);
+        }
+    }
+    // What is left are cycles no edge enters, each is one block.
+    for (Node* node : byId) {
+        if (node != nullptr && _block[node->id()] == NONE && hasCFG(node)) {
+            grow(node);
+        }
+    }
+    _begin.push_back(static_cast<Index>(_nodes.size()));
+
+    _succOffsets.reserve(_begin.size());
+    _predOffsets.reserve(_begin.size());
+    for (Index block = 0; block < size(); block++) {
+        _succOffsets.push_back(static_cast<Index>(_succs.size()));
+        _predOffsets.push_back(static_cast<Index>(_preds.size()));
+        Node* last = _nodes[_begin[block + 1] - 1];
+        for (Edge* e : last->outEdges(EdgeType::CFG)) {
+            _succs.push_back(_block[e->dest()->id()]);
+        }
+        Node* first = _nodes[_begin[block]];
+        for (Edge* e : first->inEdges(EdgeType::CFG)) {
+            _preds.push_back(_block[e->src()->id()]);
+        }
+    }
+    _succOffsets.push_back(static_cast<Index>(_succs.size()));
+    _predOffsets.push_back(static_cast<Index>(_preds.size()));
+}
+
+size_t BasicBlocks::getMemoryUsage() const {
+    size_t result = sizeof(*this) + _nodes.capacity() * sizeof(Node*);
+    for (auto* v : {&_block, &_position, &_begin, &_succOffsets, &_succs,
+                    &_predOffsets, &_preds}) {
+        result += v->capacity() * sizeof(Index);
+    }
+    return result;
+}
+
+PropertyColumns::PropertyColumns(const Graph* graph,
+                                 const std::vector<Node*>& nodes)
+    : graph(graph) {
+    for (auto column : {&index, &nargs, &nresults, &offset}) {
+        column->resize(nodes.size(), 0);
+    }
+    type.resize(nodes.size(), NodeType::Module);
+    instType.resize(nodes.size(), InstType::None);
+    opcode.resize(nodes.size(), Opcode());
+    name.resize(nodes.size());
+    label.resize(nodes.size());
+    // Only the getters a node overrides are called, the others would warn.
+    for (Node* node : nodes) {
+        Index id = node->id();
+        type[id] = node->type();
+        offset[id] = node->offset();
+        label[id] = node->labelSymbol();
+        switch (node->type()) {
+        case NodeType::Module:
+            name[id] = node->nameSymbol();
+            break;
+        case NodeType::SignatureHub:
+            name[id] = node->nameSymbol();
+            index[id] = node->index();
+            break;
+        case NodeType::Function:
+            name[id] = node->nameSymbol();
+            index[id] = node->index();
+            nargs[id] = node->nargs();
+            nresults[id] = node->nresults();
+            break;
+        case NodeType::VarNode:
+            name[id] = node->nameSymbol();
+            index[id] = node->index();
+            break;
+        case NodeType::Instruction:
+            instType[id] = node->instType();
+            switch (node->instType()) {
+            case InstType::Binary:
+            case InstType::Compare:
+            case InstType::Convert:
+            case InstType::Unary:
+            case InstType::Load:
+            case InstType::Store:
+                opcode[id] = node->opcode();
+                break;
+            case InstType::Call:
+            case InstType::CallIndirect:
+                nargs[id] = node->nargs();
+                nresults[id] = node->nresults();
+                break;
+            case InstType::BeginBlock:
+            case InstType::Block:
+            case InstType::Loop:
+            case InstType::EndLoop:
+            case InstType::If:
+                nresults[id] = node->nresults();
+                break;
+            default:
+                break;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+Node* PropertyColumns::node(Index id) const {
+    return graph->nodeById(id);
+}
+
+size_t PropertyColumns::getMemoryUsage() const {
+    size_t result = sizeof(*this);
+    result += type.capacity() * sizeof(NodeType);
+    result += instType.capacity() * sizeof(InstType);
+    result += opcode.capacity() * sizeof(Opcode);
+    result += (index.capacity() + nargs.capacity() + nresults.capacity() +
+               offset.capacity()) *
+              sizeof(Index);
+    result += (name.capacity() + label.capacity()) * sizeof(Symbol);
+    return result;
+}
+
+const Index ASTIntervals::NONE;
+
+ASTIntervals::ASTIntervals(Node* root, Index numIds)
+    : _pre(numIds, NONE),
+      _last(numIds, NONE),
+      _function(numIds, nullptr),
+      _tree(true) {
+    // Iterative DFS, each entry holds a node and its next child to visit.
+    std::vector<std::pair<Node*, Index>> stack;
+    _pre[root->id()] = 0;
+    _order.push_back(root);
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+        Node* node = stack.back().first;
+        auto children = node->outEdges(EdgeType::AST);
+        if (stack.back().second == children.size()) {
+            _last[node->id()] = static_cast<Index>(_order.size() - 1);
+            stack.pop_back();
+            continue;
+        }
+        Node* child = children[stack.back().second++]->dest();
+        if (_pre[child->id()] != NONE) {
+            // A node with two AST parents, the intervals would be wrong.
+            _tree = false;
+            return;
+        }
+        _pre[child->id()] = static_cast<Index>(_order.size());
+        _function[child->id()] = child->type() == NodeType::Function
+                                     ? child
+                                     : _function[node->id()];
+        _order.push_back(child);
+        stack.emplace_back(child, 0);
+    }
+}
+
+size_t ASTIntervals::getMemoryUsage() const {
+    size_t result = sizeof(*this);
+    result += (_pre.capacity() + _last.capacity()) * sizeof(Index);
+    result += (_function.capacity() + _order.capacity()) * sizeof(Node*);
+    return result;
+}
+
+void to_json(json& j, const GraphStats& stats) {
+    json nodeTypes, instTypes, edgeTypes, pdgTypes;
+#define WASMATI_ENUMS_NODE_TYPE(type, name) nodeTypes[name] = stats.nodes(type);
+#define WASMATI_ENUMS_INST_TYPE(type, name) instTypes[name] = stats.insts(type);
+#define WASMATI_ENUMS_EDGE_TYPE(type, name) edgeTypes[name] = stats.edges(type);
+#define WASMATI_ENUMS_PDG_EDGE_TYPE(type, name) \
+    pdgTypes[name] = stats.edges(type);
+#include "src/config/enums.def"
+#undef WASMATI_ENUMS_NODE_TYPE
+#undef WASMATI_ENUMS_INST_TYPE
+#undef WASMATI_ENUMS_EDGE_TYPE
+#undef WASMATI_ENUMS_PDG_EDGE_TYPE
+    j = json{{"nodes", stats.nodes()},
+             {"edges", stats.edges()},
+             {"nodeTypes", nodeTypes},
+             {"instTypes", instTypes},
+             {"edgeTypes", edgeTypes},
+             {"pdgTypes", pdgTypes}};
+}
+
+GraphMemory Graph::getMemory() const {
+    GraphMemory result;
+    // Nodes and edges are counted by the pages of their arenas, which also
+    // covers the space lost to padding and to the end of the last page.
+    result.nodes = sizeof(*this) + _nodeArena.bytesReserved() +
+                   memory::heapBytes(_nodes) + memory::heapBytes(_byId) +
+                   memory::heapBytes(_locations);
+    result.edges = _edgeArena.bytesReserved();
+    result.labels = _strings.getMemoryUsage() + _constants.getMemoryUsage();
+    for (Node* node : _nodes) {
+        result.adjacency +=
+            node->_inEdges.heapBytes() + node->_outEdges.heapBytes();
+    }
+    if (_frozen) {
+        result.adjacency += _frozen->getMemoryUsage();
+    }
+    if (_blocks) {
+        result.adjacency += _blocks->getMemoryUsage();
+    }
+    if (_columns) {
+        result.queryCaches += _columns->getMemoryUsage();
+    }
+    if (_intervals) {
+        result.queryCaches += _intervals->getMemoryUsage();
+    }
+    return result;
+}
+
+static bool locationBefore(const NodeLocation& entry, Index node) {
+    return entry.node < node;
+}
+
+void Graph::setLocation(const Node* node, const Location& loc) {
+    assert(!_sealed);
+    assert(node->graph() == this);
+    NodeLocation entry;
+    entry.node = node->id();
+    entry.filename =
+        intern(std::string(loc.filename.begin(), loc.filename.end()));
+    entry.line = loc.line;
+    entry.firstColumn = loc.first_column;
+    entry.lastColumn = loc.last_column;
+    addLocation(entry);
+}
+
+void Graph::addLocation(const NodeLocation& entry) {
+    if (_locations.empty() || _locations.back().node < entry.node) {
+        _locations.push_back(entry);
+        return;
+    }
+    auto it = std::lower_bound(_locations.begin(), _locations.end(),
+                               entry.node, locationBefore);
+    if (it != _locations.end() && it->node == entry.node) {
+        *it = entry;
+    } else {
+        _locations.insert(it, entry);
+    }
+}
+
+void Graph::merge(GraphBuffer& buffer) {
+    assert(!_sealed);
+    std::vector<Symbol> symbols(buffer._strings.size());
+    for (Index i = 0; i < symbols.size(); i++) {
+        symbols[i] = intern(buffer._strings.str(Symbol(i)));
+    }
+    for (Node* node : buffer._created) {
+        assert(node->_graph == nullptr);
+        node->remapSymbols(symbols);
+        node->_id = static_cast<Index>(_byId.size());
+        node->_graph = this;
+        _byId.push_back(node);
+    }
+    _columns.reset();
+    for (Node* node : buffer._inserted) {
+        insertNode(node);
+    }
+    for (auto const& edge : buffer._edges) {
+        if (edge.type == EdgeType::AST) {
+            newEdge<ASTEdge>(edge.src, edge.dest);
+        } else {
+            Node* dest = edge.dest != nullptr ? edge.dest : getTrap();
+            newEdge<CFGEdge>(edge.src, dest, symbols[edge.label.id()]);
+        }
+    }
+    for (auto const& location : buffer._locations) {
+        NodeLocation entry = location.second;
+        entry.node = location.first->id();
+        entry.filename = symbols[entry.filename.id()];
+        addLocation(entry);
+    }
+}
+
+Location Graph::location(const Node* node) const {
+    Location loc;
+    auto it = std::lower_bound(_locations.begin(), _locations.end(),
+                               node->id(), locationBefore);
+    if (it == _locations.end() || it->node != node->id()) {
+        return loc;
+    }
+    loc.filename = _strings.str(it->filename);
+    loc.line = it->line;
+    loc.first_column = it->firstColumn;
+    loc.last_column = it->lastColumn;
+    return loc;
+}
+
+void Graph::numberAST() {
+    assert(!_sealed);
+    _intervals.reset(
+        new ASTIntervals(getModule(), static_cast<Index>(_byId.size())));
+    if (!_intervals->isTree()) {
+        _intervals.reset();
+    }
+}
+
+void Graph::freeze() {
+    assert(!_sealed);
+    // The indexes would miss the edges of deferred functions, and reading
+    // their CFG edges would build them all.
+    if (!hasDeferred()) {
+        _frozen.reset(new FrozenIndex(_nodes));
+        if (cpgOptions.basicBlocks && !_blocks) {
+            indexBasicBlocks();
+        }
+    }
+    _columns.reset(new PropertyColumns(this, _byId));
+    if (!_intervals && _module != nullptr) {
+        numberAST();
+    }
+}
+
+void Graph::indexBasicBlocks() {
+    assert(!hasDeferred());
+    _blocks.reset(new BasicBlocks(_byId));
+}
+
+void Graph::seal() {
+    assert(!hasDeferred());
+    // Graphs frozen right before sealing are not indexed again.
+    if (!_frozen || !_columns || (!_intervals && _module != nullptr)) {
+        freeze();
+    }
+    _sealed = true;
+}
+
+void Graph::defer(std::function<void(Node*)> materializer) {
+    assert(!_sealed && _numDeferred == 0);
+    if (!_intervals) {
+        numberAST();
+    }
+    // The function of a node is found through the AST numbering.
+    assert(_intervals != nullptr);
+    _materializer = std::move(materializer);
+    _deferred.assign(_byId.size(), false);
+    for (Node* node : _nodes) {
+        if (node->type() == NodeType::Function && !node->isImport() &&
+            _intervals->contains(node)) {
+            _deferred[node->id()] = true;
+            _numDeferred++;
+        }
+    }
+    _frozen.reset();
+}
+
+void Graph::materialize(const Node* node) {
+    if (!_intervals->contains(node)) {
+        return;
+    }
+    Node* func = _intervals->function(node);
+    if (func == nullptr || !_deferred[func->id()]) {
+        return;
+    }
+    assert(!_sealed);
+    // Cleared first, the materializer reads the edges of the function.
+    _deferred[func->id()] = false;
+    _numDeferred--;
+    _materializer(func);
+}
+
+void Graph::materializeAll() {
+    for (Node* node : _nodes) {
+        if (!hasDeferred()) {
+            break;
+        }
+        if (node->type() == NodeType::Function && _deferred[node->id()]) {
+            materialize(node);
+        }
+    }
+}
+
+NodeSet::const_iterator NodeSet::begin() const {
+    if (!dense()) {
+        return const_iterator(this, 0, 0);
+    }
+    for (size_t pos = 0; pos < _words.size(); pos++) {
+        if (_words[pos] != 0) {
+            return const_iterator(this, pos, _words[pos]);
+        }
+    }
+    return end();
+}
+
+Node* NodeSet::back() const {
+    assert(!empty());
+    if (!dense()) {
+        return _small.back();
+    }
+    for (size_t pos = _words.size(); pos-- > 0;) {
+        if (_words[pos] != 0) {
+            Index bit = WORD_BITS - 1 - countLeadingZeros(_words[pos]);
+            return _graph->nodeById(
+                (_firstWord + static_cast<Index>(pos)) * WORD_BITS + bit);
+        }
+    }
+    assert(false);
+    return nullptr;
+}
+
+bool NodeSet::erase(const Node* node) {
+    if (dense()) {
+        if (count(node) == 0) {
+            return false;
+        }
+        Index id = node->id();
+        uint64_t mask = uint64_t(1) << (id % WORD_BITS);
+        _words[id / WORD_BITS - _firstWord] &= ~mask;
+        _size--;
+        return true;
+    }
+    auto it = lowerBound(node->id());
+    if (it == _small.end() || *it != node) {
+        return false;
+    }
+    _small.erase(it);
+    _size--;
+    return true;
+}
+
+void NodeSet::clear() {
+    _small.clear();
+    _words.clear();
+    _firstWord = 0;
+    _size = 0;
+    _graph = nullptr;
+}
+
+bool NodeSet::insertBit(Node* node) {
+    assert(node->graph() == _graph);
+    Index word = node->id() / WORD_BITS;
+    if (word < _firstWord) {
+        _words.insert(_words.begin(), _firstWord - word, 0);
+        _firstWord = word;
+    } else if (word - _firstWord >= _words.size()) {
+        _words.resize(word - _firstWord + 1, 0);
+    }
+    uint64_t& bits = _words[word - _firstWord];
+    uint64_t mask = uint64_t(1) << (node->id() % WORD_BITS);
+    if ((bits & mask) != 0) {
+        return false;
+    }
+    bits |= mask;
+    _size++;
+    return true;
+}
+
+void NodeSet::densify() {
+    // A bitset pays one word per 64 ids of the range it covers, switch only
+    // when that is no more than the vector it replaces.
+    Index firstWord = _small.front()->id() / WORD_BITS;
+    Index lastWord = _small.back()->id() / WORD_BITS;
+    if (lastWord - firstWord + 1 > _small.size()) {
+        return;
+    }
+    _graph = _small.front()->graph();
+    _firstWord = firstWord;
+    _words.assign(lastWord - firstWord + 1, 0);
+    for (Node* node : _small) {
+        assert(node->graph() == _graph);
+        Index id = node->id();
+        _words[id / WORD_BITS - _firstWord] |= uint64_t(1) << (id % WORD_BITS);
+    }
+    std::vector<Node*>().swap(_small);
+}
+
+void NodeSet::countBits() {
+    _size = 0;
+    for (uint64_t bits : _words) {
+        _size += popcount(bits);
+    }
+}
+
+NodeSet& NodeSet::unite(const NodeSet& other) {
+    if (this == &other || other.empty()) {
+        return *this;
+    }
+    if (!other.dense() || (dense() && _graph != other._graph)) {
+        insert(other.begin(), other.end());
+        return *this;
+    }
+    if (!dense()) {
+        NodeSet result(other);
+        result.insert(_small.begin(), _small.end());
+        std::swap(*this, result);
+        return *this;
+    }
+    Index lastWord = std::max(_firstWord + static_cast<Index>(_words.size()),
+                              other._firstWord +
+                                  static_cast<Index>(other._words.size()));
+    if (other._firstWord < _firstWord) {
+        _words.insert(_words.begin(), _firstWord - other._firstWord, 0);
+        _firstWord = other._firstWord;
+    }
+    _words.resize(lastWord - _firstWord, 0);
+    Index offset = other._firstWord - _firstWord;
+    for (size_t i = 0; i < other._words.size(); i++) {
+        _words[offset + i] |= other._words[i];
+    }
+    countBits();
+    return *this;
+}
+
+NodeSet& NodeSet::intersect(const NodeSet& other) {
+    if (this == &other) {
+        return *this;
+    }
+    if (dense() && other.dense() && _graph == other._graph) {
+        for (size_t i = 0; i < _words.size(); i++) {
+            Index word = _firstWord + static_cast<Index>(i);
+            if (word < other._firstWord ||
+                word - other._firstWord >= other._words.size()) {
+                _words[i] = 0;
+            } else {
+                _words[i] &= other._words[word - other._firstWord];
+            }
+        }
+        countBits();
+        return *this;
+    }
+    const NodeSet& smaller = size() <= other.size() ? *this : other;
+    const NodeSet& larger = size() <= other.size() ? other : *this;
+    NodeSet result;
+    for (Node* node : smaller) {
+        if (larger.count(node) == 1) {
+            result.insert(node);
+        }
+    }
+    std::swap(*this, result);
+    return *this;
+}
+
+bool NodeSet::operator==(const NodeSet& other) const {
+    if (size() != other.size()) {
+        return false;
+    }
+    return std::equal(begin(), end(), other.begin());
+}
+
 bool CompareNode::operator()(Node* const& n1, Node* const& n2) const {
     return n1->id() < n2->id();
 }
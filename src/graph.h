@@ -1,11 +1,23 @@
 #ifndef WASMATI_GRAPH_H
 #define WASMATI_GRAPH_H
 #define NOMINMAX 1
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "src/arena.h"
 #include "src/cast.h"
 #include "src/ir-util.h"
+#include "src/memory-usage.h"
 #include "src/options.h"
+#include "src/string-table.h"
 #include "src/utils.h"
 
 using namespace wabt;
@@ -13,6 +25,8 @@ namespace wasmati {
 class GraphVisitor;
 struct Edge;
 class Node;
+class Graph;
+class NodeSet;
 class Predicate;
 
 struct CompareNode {
@@ -21,7 +35,6 @@ struct CompareNode {
 struct CompareEdge {
     bool operator()(Edge* const& e1, Edge* const& e2) const;
 };
-typedef std::set<Node*, CompareNode> NodeSet;
 typedef std::set<Edge*, CompareEdge> EdgeSet;
 
 inline const std::string& emptyString() {
@@ -35,6 +48,7 @@ inline const Const& emptyConst() {
 }
 
 enum class EdgeType { AST, CFG, PDG, CG, None };
+const unsigned NUM_EDGE_TYPES = static_cast<unsigned>(EdgeType::None);
 
 enum class NodeType {
     Module,
@@ -49,6 +63,7 @@ enum class NodeType {
     Else,
     Trap,
     Start,
+    SignatureHub,
 };
 
 enum class InstType {
@@ -88,15 +103,104 @@ extern const std::map<NodeType, std::string> NODE_TYPE_MAP;
 extern const std::map<std::string, NodeType> NODE_TYPE_MAP_R;
 extern const std::map<InstType, std::string> INST_TYPE_MAP;
 extern const std::map<std::string, InstType> INST_TYPE_MAP_R;
+
+/// Non-owning view over a contiguous run of edges.
+class EdgeRange {
+    Edge* const* _begin;
+    Edge* const* _end;
+
+public:
+    typedef Edge* const* iterator;
+    typedef Edge* const* const_iterator;
+
+    EdgeRange() : _begin(nullptr), _end(nullptr) {}
+    EdgeRange(Edge* const* begin, Edge* const* end)
+        : _begin(begin), _end(end) {}
+
+    inline iterator begin() const { return _begin; }
+    inline iterator end() const { return _end; }
+    inline size_t size() const { return _end - _begin; }
+    inline bool empty() const { return _begin == _end; }
+    inline Edge* operator[](size_t i) const {
+        assert(i < size());
+        return _begin[i];
+    }
+
+    inline operator EdgeSet() const { return EdgeSet(_begin, _end); }
+};
+
+/// Non-owning view over a contiguous run of nodes.
+class NodeRange {
+    Node* const* _begin;
+    Node* const* _end;
+
+public:
+    typedef Node* const* iterator;
+    typedef Node* const* const_iterator;
+
+    NodeRange() : _begin(nullptr), _end(nullptr) {}
+    NodeRange(Node* const* begin, Node* const* end)
+        : _begin(begin), _end(end) {}
+
+    inline iterator begin() const { return _begin; }
+    inline iterator end() const { return _end; }
+    inline size_t size() const { return _end - _begin; }
+    inline bool empty() const { return _begin == _end; }
+};
+
+/// The edges of one direction of a node, grouped by EdgeType in a single
+/// array. Every type occupies a contiguous bucket ordered by the id of the
+/// node at the other end, and by insertion among edges to the same node, so
+/// the n-th child or parent of a type is found by indexing.
+/// Unlike an EdgeSet, a bucket keeps every edge added, equal ones included.
+class EdgeBuckets {
+    static const unsigned NUM_BUCKETS = NUM_EDGE_TYPES;
+
+    Edge** _edges;
+    uint32_t _ends[NUM_BUCKETS];
+    uint32_t _capacity;
+    const bool _incoming;
+
+    Index neighbourId(const Edge* e) const;
+
+public:
+    explicit EdgeBuckets(bool incoming)
+        : _edges(nullptr), _ends(), _capacity(0), _incoming(incoming) {}
+    EdgeBuckets(const EdgeBuckets&) = delete;
+    EdgeBuckets& operator=(const EdgeBuckets&) = delete;
+    ~EdgeBuckets() { std::free(_edges); }
+
+    void insert(Edge* e, EdgeType type);
+
+    inline size_t size() const { return _ends[NUM_BUCKETS - 1]; }
+    inline size_t capacity() const { return _capacity; }
+    inline size_t heapBytes() const { return _capacity * sizeof(Edge*); }
+    inline EdgeRange all() const { return EdgeRange(_edges, _edges + size()); }
+    inline EdgeRange of(EdgeType type) const {
+        unsigned bucket = static_cast<unsigned>(type);
+        if (bucket >= NUM_BUCKETS) {
+            return EdgeRange();
+        }
+        uint32_t begin = bucket == 0 ? 0 : _ends[bucket - 1];
+        return EdgeRange(_edges + begin, _edges + _ends[bucket]);
+    }
+};
+
 class Node {
-    static Index idCount;
-    const Index _id;
-    std::vector<Edge*> _inEdges;
-    std::vector<Edge*> _outEdges;
+    Index _id;
 
 public:
     const NodeType _type;
 
+private:
+    Graph* _graph;
+    EdgeBuckets _inEdges;
+    EdgeBuckets _outEdges;
+
+    friend class Graph;
+
+public:
+
     // Properties
     NodeType type() const { return _type; }
 
@@ -144,10 +248,20 @@ public:
         warning(false);
         return emptyConst();
     }
+    virtual Symbol nameSymbol() const {
+        warning(false);
+        return Symbol();
+    }
     virtual const std::string& label() const { return emptyString(); }
+    virtual Symbol labelSymbol() const { return Symbol(); }
+    /// Replaces every symbol s of the node by symbols[s.id()]. Used when the
+    /// node was made against a string table other than its graph's.
+    virtual void remapSymbols(const std::vector<Symbol>& symbols) {}
     virtual bool hasElse() const { return false; }
     virtual Index offset() const { return 0; }
-    virtual Location location() const { return {}; }
+    /// Source location of the node, kept by the graph apart from the node.
+    /// Empty if none was recorded.
+    Location location() const;
     virtual Node* block() {
         assert(false);
         return nullptr;
@@ -157,21 +271,53 @@ public:
         return nullptr;
     }
 
-    explicit Node(NodeType type) : _id(idCount++), _type(type) {}
-    virtual ~Node();
+    explicit Node(NodeType type)
+        : _id(0),
+          _type(type),
+          _graph(nullptr),
+          _inEdges(true),
+          _outEdges(false) {}
+    virtual ~Node() {}
 
+    /// Dense id of the node within its graph, assigned in creation order.
     inline Index id() const { return _id; }
+    /// Graph that owns the node, null if it was not created by a Graph.
+    inline Graph* graph() const { return _graph; }
+    /// Interns a string in the symbol table of the graph that owns the node.
+    Symbol intern(const std::string& str) const;
+    /// String of a symbol of the graph that owns the node.
+    const std::string& symbolString(Symbol symbol) const;
+    /// Adds a constant to the ConstantPool of the graph that owns the node.
+    Index internConstant(const Const& value) const;
     inline const EdgeSet inEdges() const {
-        return EdgeSet(_inEdges.begin(), _inEdges.end());
+        complete();
+        auto edges = _inEdges.all();
+        return EdgeSet(edges.begin(), edges.end());
     }
     inline const EdgeSet outEdges() const {
-        return EdgeSet(_outEdges.begin(), _outEdges.end());
+        complete();
+        auto edges = _outEdges.all();
+        return EdgeSet(edges.begin(), edges.end());
+    }
+    /// Edges of the given type, ordered by the id of the node at the other
+    /// end. The view is only valid until an edge of this node is added.
+    inline EdgeRange inEdges(EdgeType type) const {
+        complete();
+        return _inEdges.of(type);
+    }
+    inline EdgeRange outEdges(EdgeType type) const {
+        complete();
+        return _outEdges.of(type);
     }
-    EdgeSet inEdges(EdgeType type);
-    EdgeSet outEdges(EdgeType type);
 
-    inline Index getNumOutEdges() const { return _outEdges.size(); }
-    inline Index getNumInEdges() const { return _inEdges.size(); }
+    inline Index getNumOutEdges() const {
+        complete();
+        return _outEdges.size();
+    }
+    inline Index getNumInEdges() const {
+        complete();
+        return _inEdges.size();
+    }
 
     Edge* getOutEdge(Index i, EdgeType type);
     Edge* getInEdge(Index i, EdgeType type);
@@ -179,8 +325,8 @@ public:
     Node* getChild(Index n, EdgeType type = EdgeType::AST);
     Node* getParent(Index n, EdgeType type = EdgeType::AST);
 
-    inline void addInEdge(Edge* e) { _inEdges.push_back(e); }
-    inline void addOutEdge(Edge* e) { _outEdges.push_back(e); }
+    void addInEdge(Edge* e);
+    void addOutEdge(Edge* e);
 
     bool hasEdgesOf(EdgeType) const;
     bool hasInEdgesOf(EdgeType) const;
@@ -188,6 +334,11 @@ public:
 
     virtual void accept(GraphVisitor* visitor);
     virtual void acceptEdges(GraphVisitor* visitor);
+
+private:
+    /// Builds what was deferred of the function of this node before its
+    /// edges are read, see Graph::defer.
+    inline void complete() const;
 };
 
 template <NodeType t>
@@ -199,21 +350,52 @@ public:
 };
 
 class Module : public BaseNode<NodeType::Module> {
-    const std::string _name;
+    Symbol _name;
 
 public:
     Module() {}
-    Module(std::string name) : _name(name) {}
-    Module(Index id_, std::string name) : _name(name) { assert(id_ == id()); }
+    Module(Symbol name) : _name(name) {}
+    Module(Index id_, Symbol name) : _name(name) {}
 
-    const std::string& name() const override { return _name; }
+    const std::string& name() const override { return symbolString(_name); }
+    Symbol nameSymbol() const override { return _name; }
+    void remapSymbols(const std::vector<Symbol>& symbols) override {
+        _name = symbols[_name.id()];
+    }
+
+    void accept(GraphVisitor* visitor) override;
+};
+
+/// Callees of the call_indirect instructions of one table and function
+/// type. With cpgOptions.signatureHubs a call_indirect has a single CG edge
+/// to the hub of its table and type, and the hub one to every function of
+/// that table with that type. Query walks through it as if the call had the
+/// edges itself.
+class SignatureHub : public BaseNode<NodeType::SignatureHub> {
+    Symbol _name;
+    Index _table;
+
+public:
+    SignatureHub() : _table(0) {}
+    SignatureHub(Symbol name, Index table) : _name(name), _table(table) {}
+    SignatureHub(Index id_, Symbol name, Index table)
+        : _name(name), _table(table) {}
+
+    /// Name of the function type.
+    const std::string& name() const override { return symbolString(_name); }
+    /// Index of the table.
+    Index index() const override { return _table; }
+    Symbol nameSymbol() const override { return _name; }
+    void remapSymbols(const std::vector<Symbol>& symbols) override {
+        _name = symbols[_name.id()];
+    }
 
     void accept(GraphVisitor* visitor) override;
 };
 
 class Function : public BaseNode<NodeType::Function> {
     Func* const _f;
-    const std::string _name;
+    Symbol _name;
     const Index _index;
     const Index _nargs;
     const Index _nlocals;
@@ -222,9 +404,9 @@ class Function : public BaseNode<NodeType::Function> {
     const bool _isExport;
 
 public:
-    Function(Func* f, Index index, bool isImport, bool isExport)
+    Function(Func* f, Symbol name, Index index, bool isImport, bool isExport)
         : _f(f),
-          _name(f->name),
+          _name(name),
           _index(index),
           _nargs(f->GetNumParams()),
           _nlocals(f->GetNumLocals()),
@@ -233,7 +415,7 @@ public:
           _isExport(isExport) {}
 
     Function(Index id_,
-             std::string name,
+             Symbol name,
              Index index,
              Index nargs,
              Index nlocals,
@@ -247,11 +429,13 @@ public:
           _nlocals(nlocals),
           _nresults(nresults),
           _isImport(isImport),
-          _isExport(isExport) {
-        assert(id_ == id());
-    }
+          _isExport(isExport) {}
 
-    const std::string& name() const override { return _name; }
+    const std::string& name() const override { return symbolString(_name); }
+    Symbol nameSymbol() const override { return _name; }
+    void remapSymbols(const std::vector<Symbol>& symbols) override {
+        _name = symbols[_name.id()];
+    }
     Index index() const override { return _index; }
     Index nargs() const override { return _nargs; }
     Index nlocals() const override { return _nlocals; }
@@ -266,19 +450,21 @@ public:
 class VarNode : public BaseNode<NodeType::VarNode> {
     Type _varType;
     const Index _index;
-    const std::string _name;
+    Symbol _name;
 
 public:
-    VarNode(Type type, Index index, std::string name = "")
+    VarNode(Type type, Index index, Symbol name = Symbol())
         : _varType(type), _index(index), _name(name) {}
 
-    VarNode(Index id_, std::string type, Index index, std::string name)
-        : _varType(readVarType(type)), _index(index), _name(name) {
-        assert(id_ == id());
-    }
+    VarNode(Index id_, std::string type, Index index, Symbol name)
+        : _varType(readVarType(type)), _index(index), _name(name) {}
 
     Type varType() const override { return _varType; }
-    const std::string& name() const override { return _name; }
+    const std::string& name() const override { return symbolString(_name); }
+    Symbol nameSymbol() const override { return _name; }
+    void remapSymbols(const std::vector<Symbol>& symbols) override {
+        _name = symbols[_name.id()];
+    }
     Index index() const override { return _index; }
     std::string writeVarType() {
         switch (_varType) {
@@ -321,7 +507,7 @@ template <NodeType T, char const* nodeName>
 class SimpleNode : public BaseNode<T> {
 public:
     SimpleNode() {}
-    SimpleNode(Index id_) { assert(id_ == this->id()); }
+    SimpleNode(Index id_) {}
     inline const std::string getNodeName() const { return nodeName; }
 
     virtual void accept(GraphVisitor* visitor);
@@ -349,32 +535,21 @@ typedef SimpleNode<NodeType::Start, startName> Start;
 class Instruction : public BaseNode<NodeType::Instruction> {
 protected:
     const InstType _instType;
-    const Location _loc;
 
 public:
-    Instruction(const InstType type, const Location loc)
-        : _instType(type), _loc(loc) {}
+    Instruction(const InstType type) : _instType(type) {}
 
-    Instruction(Index id_, const InstType type, const Location loc)
-        : _instType(type), _loc(loc) {
-        assert(id_ == id());
-    }
+    Instruction(Index id_, const InstType type) : _instType(type) {}
 
     InstType instType() const override { return _instType; }
-
-    Location location() const override { return _loc; }
 };
 
 template <InstType exprType>
 class BaseInstruction : public Instruction {
 public:
-    BaseInstruction(const Location _loc = Location())
-        : Instruction(exprType, _loc) {}
+    BaseInstruction() : Instruction(exprType) {}
 
-    BaseInstruction(Index id_, const Location _loc = Location())
-        : Instruction(exprType, _loc) {
-        assert(id_ == id());
-    }
+    BaseInstruction(Index id_) : Instruction(exprType) {}
 
     static bool classof(const Node* node) {
         return Instruction::classof(node) && (node->instType() == exprType);
@@ -397,9 +572,9 @@ class ConstInst : public BaseInstruction<InstType::Const> {
 
 public:
     ConstInst(const ConstExpr* expr)
-        : BaseInstruction(expr->loc), _value(expr->const_) {}
+        : _value(expr->const_) {}
 
-    ConstInst(Index id_, Const& value) : _value(value) { assert(id_ == id()); }
+    ConstInst(Index id_, Const& value) : _value(value) {}
 
     const Const& value() const override { return _value; }
 
@@ -411,11 +586,9 @@ class OpcodeInst : public BaseInstruction<T> {
     Opcode _opcode;
 
 public:
-    OpcodeInst(Opcode opcode, const Location loc)
-        : BaseInstruction<T>(loc), _opcode(opcode) {}
+    OpcodeInst(Opcode opcode) : _opcode(opcode) {}
 
-    OpcodeInst(Index id, std::string opcode, Location loc = Location())
-        : BaseInstruction<T>(id, loc) {
+    OpcodeInst(Index id, std::string opcode) : BaseInstruction<T>(id) {
         bool assigned = false;
         {
 #define WABT_OPCODE(rtype, type1, type2, type3, mem_size, prefix, code, Name, \
@@ -447,14 +620,11 @@ class LoadStoreBase : public OpcodeInst<T> {
     const Index _offset;
 
 public:
-    LoadStoreBase(Opcode opcode, Index offset, Location loc = Location())
-        : OpcodeInst<T>(opcode, loc), _offset(offset) {}
+    LoadStoreBase(Opcode opcode, Index offset)
+        : OpcodeInst<T>(opcode), _offset(offset) {}
 
-    LoadStoreBase(Index id,
-                  std::string opcode,
-                  Index offset,
-                  Location loc = Location())
-        : OpcodeInst<T>(id, opcode, loc), _offset(offset) {}
+    LoadStoreBase(Index id, std::string opcode, Index offset)
+        : OpcodeInst<T>(id, opcode), _offset(offset) {}
 
     Index offset() const override { return _offset; }
 
@@ -466,15 +636,20 @@ typedef LoadStoreBase<InstType::Store> StoreInst;
 
 template <InstType T>
 class LabeledInst : public BaseInstruction<T> {
-    const std::string _label;
+    Symbol _label;
 
 public:
-    LabeledInst(std::string label, const Location loc = Location())
-        : BaseInstruction<T>(loc), _label(label) {}
-    LabeledInst(Index id, std::string label, const Location loc = Location())
-        : BaseInstruction<T>(id, loc), _label(label) {}
+    LabeledInst(Symbol label) : _label(label) {}
+    LabeledInst(Index id, Symbol label)
+        : BaseInstruction<T>(id), _label(label) {}
 
-    const std::string& label() const { return _label; }
+    const std::string& label() const override {
+        return this->symbolString(_label);
+    }
+    Symbol labelSymbol() const override { return _label; }
+    void remapSymbols(const std::vector<Symbol>& symbols) override {
+        _label = symbols[_label.id()];
+    }
 
     virtual void accept(GraphVisitor* visitor);
 };
@@ -493,19 +668,10 @@ class CallBase : public LabeledInst<T> {
     const Index _nresults;
 
 public:
-    CallBase(const CallExpr* expr, Location loc, Index nargs, Index nresults)
-        : LabeledInst<T>(expr->var.name(), loc),
-          _nargs(nargs),
-          _nresults(nresults) {}
-    CallBase(const CallIndirectExpr* expr,
-             Location loc,
-             Index nargs,
-             Index nresults)
-        : LabeledInst<T>(expr->table.name(), loc),
-          _nargs(nargs),
-          _nresults(nresults) {}
+    CallBase(Symbol label, Index nargs, Index nresults)
+        : LabeledInst<T>(label), _nargs(nargs), _nresults(nresults) {}
 
-    CallBase(Index id, Index nargs, Index nresults, std::string label)
+    CallBase(Index id, Index nargs, Index nresults, Symbol label)
         : LabeledInst<T>(id, label), _nargs(nargs), _nresults(nresults) {}
 
     Index nargs() const override { return _nargs; }
@@ -529,17 +695,16 @@ public:
     // BlockBase(const BlockExprBase<T>* expr, Index nresults)
     //    : LabeledInst<T>(expr->block.label, expr->loc), _nresults(nresults) {}
 
-    BlockBase(std::string label, Index nresults, Location loc = Location())
-        : LabeledInst<T>(label, loc), _nresults(nresults) {}
+    BlockBase(Symbol label, Index nresults)
+        : LabeledInst<T>(label), _nresults(nresults) {}
 
-    BlockBase(const Block& block)
-        : LabeledInst<T>(block.label, block.end_loc),
-          _nresults(block.decl.GetNumResults()) {}
+    BlockBase(const Block& block, Symbol label)
+        : LabeledInst<T>(label), _nresults(block.decl.GetNumResults()) {}
 
-    BlockBase(Index id, Index nresults, std::string label)
+    BlockBase(Index id, Index nresults, Symbol label)
         : LabeledInst<T>(id, label), _nresults(nresults) {}
 
-    BlockBase(Index nresults, std::string label)
+    BlockBase(Index nresults, Symbol label)
         : LabeledInst<T>(label), _nresults(nresults) {}
 
     Index nresults() const override { return _nresults; }
@@ -556,13 +721,11 @@ class BeginBlockInst : public BlockBase<InstType::BeginBlock> {
     BlockInst* _block;
 
 public:
-    BeginBlockInst(std::string label,
-                   BlockInst* block,
-                   const Location loc = Location())
-        : BlockBase<InstType::BeginBlock>(label, block->nresults(), loc),
+    BeginBlockInst(Symbol label, BlockInst* block)
+        : BlockBase<InstType::BeginBlock>(label, block->nresults()),
           _block(block) {}
 
-    BeginBlockInst(Index id, Index nresults, std::string label)
+    BeginBlockInst(Index id, Index nresults, Symbol label)
         : BlockBase<InstType::BeginBlock>(id, nresults, label),
           _block(nullptr) {}
 
@@ -580,8 +743,7 @@ class IfInst : public BaseInstruction<InstType::If> {
 
 public:
     IfInst(const IfExpr* expr)
-        : BaseInstruction(expr->loc),
-          _nresults(expr->true_.decl.GetNumResults()),
+        : _nresults(expr->true_.decl.GetNumResults()),
           _hasElse(!expr->false_.empty()) {}
 
     IfInst(Index id, Index nresults, bool hasElse)
@@ -599,29 +761,92 @@ extern const std::map<std::string, EdgeType> EDGE_TYPES_MAP_R;
 extern const std::map<PDGType, std::string> PDG_TYPE_MAP;
 extern const std::map<std::string, PDGType> PDG_TYPE_MAP_R;
 
+/// Constants carried by the PDG Const edges of a graph. Every distinct
+/// constant is stored once, with its rendering interned as the edge label.
+class ConstantPool {
+    struct Key {
+        unsigned type;
+        uint64_t bits;
+
+        Key(const Const& value);
+
+        inline bool operator==(const Key& other) const {
+            return type == other.type && bits == other.bits;
+        }
+
+        struct Hash {
+            inline size_t operator()(const Key& key) const {
+                return std::hash<uint64_t>()(key.bits) * 31 + key.type;
+            }
+        };
+    };
+
+    std::vector<Const> _values;
+    std::vector<Symbol> _labels;
+    std::unordered_map<Key, Index, Key::Hash> _index;
+
+public:
+    /// Index of value in the pool, adding it and interning its label in
+    /// strings if it was not there yet.
+    Index intern(const Const& value, StringTable& strings);
+
+    inline const Const& value(Index i) const { return _values[i]; }
+    inline Symbol label(Index i) const { return _labels[i]; }
+    inline size_t size() const { return _values.size(); }
+
+    size_t getMemoryUsage() const;
+};
+
+/// An edge is a fixed size record without a vtable: its ends, its type, its
+/// PDG type and a 32-bit payload. The payload is the label symbol of CFG and
+/// PDG edges, or the index in the graph ConstantPool of the constant of a
+/// PDG Const edge. The subclasses only add constructors and classof.
+/// Graph::newEdge links an edge to its ends, one built anywhere else is a
+/// view no node lists, see Query::forEachThroughHub.
 struct Edge {
 private:
     Node* const _src;
     Node* const _dest;
-    const EdgeType _type;
+    const uint8_t _type;
+    const uint8_t _pdgType;
+    const uint32_t _payload;
+
+    inline bool isConst() const { return pdgType() == PDGType::Const; }
 
 public:
-    Edge(Node* src, Node* dest, EdgeType type)
-        : _src(src), _dest(dest), _type(type) {
+    Edge(Node* src,
+         Node* dest,
+         EdgeType type,
+         PDGType pdgType = PDGType::None,
+         uint32_t payload = 0)
+        : _src(src),
+          _dest(dest),
+          _type(static_cast<uint8_t>(type)),
+          _pdgType(static_cast<uint8_t>(pdgType)),
+          _payload(payload) {
         assert(src != nullptr && dest != nullptr);
-        src->addOutEdge(this);
-        dest->addInEdge(this);
     }
 
-    virtual ~Edge() {}
-
     inline Node* src() const { return _src; }
     inline Node* dest() const { return _dest; }
-    inline EdgeType type() const { return _type; }
-    virtual PDGType pdgType() const { return PDGType::None; }
-    virtual const std::string& label() const { return emptyString(); }
-    virtual const Const& value() const { return emptyConst(); }
-    virtual void accept(GraphVisitor* visitor) = 0;
+    inline EdgeType type() const { return static_cast<EdgeType>(_type); }
+    inline PDGType pdgType() const { return static_cast<PDGType>(_pdgType); }
+    inline Symbol labelSymbol() const {
+        return isConst() ? constLabel() : Symbol(_payload);
+    }
+    /// The label is rendered from the symbol table of the graph.
+    inline const std::string& label() const {
+        return _src->symbolString(labelSymbol());
+    }
+    /// Constant of a PDG Const edge, an empty one for other edges.
+    inline const Const& value() const {
+        return isConst() ? constValue() : emptyConst();
+    }
+    void accept(GraphVisitor* visitor);
+
+private:
+    Symbol constLabel() const;
+    const Const& constValue() const;
 
 public:
     inline static EdgeType type(std::string typeName) {
@@ -632,39 +857,40 @@ public:
 
 struct ASTEdge : Edge {
     ASTEdge(Node* src, Node* dest) : Edge(src, dest, EdgeType::AST) {}
-    void accept(GraphVisitor* visitor);
     static bool classof(const Edge* e) { return e->type() == EdgeType::AST; }
 };
 
 struct CFGEdge : Edge {
-    const std::string _label;
-
     CFGEdge(Node* src, Node* dest) : Edge(src, dest, EdgeType::CFG) {}
+    CFGEdge(Node* src, Node* dest, Symbol label)
+        : Edge(src, dest, EdgeType::CFG, PDGType::None, label.id()) {}
     CFGEdge(Node* src, Node* dest, const std::string& label)
-        : Edge(src, dest, EdgeType::CFG), _label(label) {}
-    void accept(GraphVisitor* visitor);
+        : CFGEdge(src, dest, src->intern(label)) {}
     static bool classof(const Edge* e) { return e->type() == EdgeType::CFG; }
-    inline const std::string& label() const { return _label; }
 };
 
 struct PDGEdge : Edge {
-    const std::string _label;
-    const PDGType _pdgType;
-
     PDGEdge(Node* src, Node* dest, PDGType type)
-        : Edge(src, dest, EdgeType::PDG), _pdgType(type) {}
+        : PDGEdge(src, dest, Symbol(), type) {}
     PDGEdge(CFGEdge* e)
-        : PDGEdge(e->src(), e->dest(), e->_label, PDGType::Control) {}
+        : PDGEdge(e->src(), e->dest(), e->labelSymbol(), PDGType::Control) {}
+    PDGEdge(Node* src, Node* dest, Symbol label, PDGType type)
+        : Edge(src, dest, EdgeType::PDG, type, label.id()) {
+        // Const edges carry a constant, see PDGEdgeConst.
+        assert(type != PDGType::Const);
+    }
     PDGEdge(Node* src, Node* dest, const std::string& label, PDGType type)
-        : Edge(src, dest, EdgeType::PDG), _label(label), _pdgType(type) {}
+        : PDGEdge(src, dest, src->intern(label), type) {}
 
-    void accept(GraphVisitor* visitor) override;
     static bool classof(const Edge* e) { return e->type() == EdgeType::PDG; }
 
-    inline const std::string& label() const override { return _label; }
-    inline PDGType pdgType() const override { return _pdgType; }
+protected:
+    PDGEdge(Node* src, Node* dest, Index constant)
+        : Edge(src, dest, EdgeType::PDG, PDGType::Const, constant) {}
 
 public:
+    using Edge::pdgType;
+
     inline static PDGType pdgType(std::string type) {
         assert(PDG_TYPE_MAP_R.count(type) == 1);
         return PDG_TYPE_MAP_R.at(type);
@@ -677,62 +903,547 @@ public:
             {PDGType::Function, "Function"},
             {PDGType::Global, "Global"},
             {PDGType::Local, "Local"}};
-        return pdgTypeMap.at(_pdgType);
+        return pdgTypeMap.at(pdgType());
     }
 };
 
 struct CGEdge : Edge {
     CGEdge(Node* src, Node* dest) : Edge(src, dest, EdgeType::CG) {}
-    void accept(GraphVisitor* visitor);
     static bool classof(const Edge* e) { return e->type() == EdgeType::CG; }
 };
 
 struct PDGEdgeConst : PDGEdge {
-    const Const _const;
-
     PDGEdgeConst(Node* src, Node* dest, const Const& const_)
-        : PDGEdge(src, dest, Utils::writeConst(const_), PDGType::Const),
-          _const(const_) {}
+        : PDGEdge(src, dest, src->internConstant(const_)) {}
+};
+
+/// Compressed sparse row adjacency of one edge type in one direction. Row r
+/// lists the edges of the r-th node of the index in EdgeSet order.
+struct CSRAdjacency {
+    std::vector<Index> offsets;
+    std::vector<Index> neighbours;
+    std::vector<Index> edges;
+
+    inline Index begin(Index row) const { return offsets[row]; }
+    inline Index end(Index row) const { return offsets[row + 1]; }
+};
+
+/// Read-only adjacency index of a graph that is no longer being built: nodes
+/// and edges are numbered densely and each edge type gets a forward and a
+/// reverse CSR, so traversals walk contiguous arrays of ids.
+class FrozenIndex {
+    Index _base;
+    std::vector<Node*> _nodes;
+    std::vector<Edge*> _edges;
+    CSRAdjacency _out[NUM_EDGE_TYPES];
+    CSRAdjacency _in[NUM_EDGE_TYPES];
+
+public:
+    explicit FrozenIndex(const std::vector<Node*>& nodes);
+
+    inline bool contains(const Node* node) const {
+        return node->id() >= _base && node->id() - _base < _nodes.size() &&
+               _nodes[node->id() - _base] == node;
+    }
+    inline Index row(const Node* node) const { return node->id() - _base; }
+    inline Node* node(Index id) const { return _nodes[id - _base]; }
+    inline Edge* edge(Index i) const { return _edges[i]; }
+    inline const CSRAdjacency& adjacency(EdgeType type, bool reverse) const {
+        assert(type != EdgeType::None);
+        unsigned t = static_cast<unsigned>(type);
+        return reverse ? _in[t] : _out[t];
+    }
+
+    size_t getMemoryUsage() const;
+};
+
+/// Basic blocks of the CFG: maximal runs of nodes in which every node but the
+/// last has a single CFG successor, the next node, and every node but the
+/// first a single CFG predecessor. Edges only enter a block at its first
+/// node and only leave it from its last one, so a walk that does not stop
+/// inside blocks can go from block to block. Nodes without CFG edges are in
+/// no block.
+class BasicBlocks {
+public:
+    static const Index NONE = ~0u;
+
+private:
+    // Block and position in _nodes by node id.
+    std::vector<Index> _block;
+    std::vector<Index> _position;
+    // The nodes of the blocks one block after the other, and where every
+    // block begins, with the end of the last one.
+    std::vector<Node*> _nodes;
+    std::vector<Index> _begin;
+    // Blocks after and before every block.
+    std::vector<Index> _succOffsets;
+    std::vector<Index> _succs;
+    std::vector<Index> _predOffsets;
+    std::vector<Index> _preds;
+
+public:
+    explicit BasicBlocks(const std::vector<Node*>& byId);
+
+    inline Index size() const { return _begin.size() - 1; }
+    inline Index blockOf(const Node* node) const {
+        return node->id() < _block.size() ? _block[node->id()] : NONE;
+    }
+    inline NodeRange nodes(Index block) const {
+        Node* const* nodes = _nodes.data();
+        return NodeRange(nodes + _begin[block], nodes + _begin[block + 1]);
+    }
+    /// Nodes of the block of node that come after it, or with reverse the
+    /// ones before it.
+    inline NodeRange rest(const Node* node, bool reverse) const {
+        assert(blockOf(node) != NONE);
+        Node* const* nodes = _nodes.data();
+        Index position = _position[node->id()];
+        Index block = _block[node->id()];
+        return reverse ? NodeRange(nodes + _begin[block], nodes + position)
+                       : NodeRange(nodes + position + 1,
+                                   nodes + _begin[block + 1]);
+    }
+    /// Calls func with every block that follows block, or with reverse
+    /// every block before it.
+    template <class F>
+    inline void forEachNeighbour(Index block, bool reverse, F func) const {
+        const std::vector<Index>& offsets = reverse ? _predOffsets
+                                                    : _succOffsets;
+        const std::vector<Index>& blocks = reverse ? _preds : _succs;
+        for (Index i = offsets[block]; i < offsets[block + 1]; i++) {
+            func(blocks[i]);
+        }
+    }
 
-    inline const Const& value() const override { return _const; }
+    size_t getMemoryUsage() const;
+};
+
+/// Node properties stored one array per property and indexed by node id, so
+/// scans over many nodes read contiguous memory instead of calling the
+/// virtual getters. A property a node does not have holds the value its
+/// getter falls back to.
+struct PropertyColumns {
+    const Graph* const graph;
+    std::vector<NodeType> type;
+    std::vector<InstType> instType;
+    std::vector<Opcode> opcode;
+    std::vector<Index> index;
+    std::vector<Index> nargs;
+    std::vector<Index> nresults;
+    std::vector<Index> offset;
+    std::vector<Symbol> name;
+    std::vector<Symbol> label;
+
+    PropertyColumns(const Graph* graph, const std::vector<Node*>& nodes);
+
+    inline size_t size() const { return type.size(); }
+    Node* node(Index id) const;
+    size_t getMemoryUsage() const;
+};
+
+/// Pre-order numbering of the AST. Every node gets its pre-order number and
+/// the last number of its subtree, so ancestry is decided by two comparisons
+/// and the descendants of a node are a contiguous run of the pre-order. Nodes
+/// that are not below the root, e.g. the ones added by the CFG, are not
+/// numbered.
+class ASTIntervals {
+    static const Index NONE = ~0u;
+
+    std::vector<Index> _pre;
+    std::vector<Index> _last;
+    std::vector<Node*> _function;
+    std::vector<Node*> _order;
+    bool _tree;
+
+public:
+    ASTIntervals(Node* root, Index numIds);
+
+    /// False if some node has more than one AST parent, the numbering is
+    /// then incomplete and must not be used.
+    inline bool isTree() const { return _tree; }
+
+    inline bool contains(const Node* node) const {
+        return node->id() < _pre.size() && _pre[node->id()] != NONE;
+    }
+    /// Whether node is ancestor itself or lies in its subtree.
+    inline bool isWithin(const Node* node, const Node* ancestor) const {
+        assert(contains(node) && contains(ancestor));
+        Index pre = _pre[node->id()];
+        return _pre[ancestor->id()] <= pre && pre <= _last[ancestor->id()];
+    }
+    /// Function the node belongs to, null above the functions.
+    inline Node* function(const Node* node) const {
+        assert(contains(node));
+        return _function[node->id()];
+    }
+    /// Nodes strictly below the given one, in pre-order.
+    inline NodeRange descendants(const Node* node) const {
+        assert(contains(node));
+        Node* const* order = _order.data();
+        return NodeRange(order + _pre[node->id()] + 1,
+                         order + _last[node->id()] + 1);
+    }
+
+    size_t getMemoryUsage() const;
+};
+
+/// Source location of a node. Locations are only read to report findings,
+/// so the graph keeps them in a table sorted by node id instead of in the
+/// nodes that traversals walk over.
+struct NodeLocation {
+    Index node;
+    Symbol filename;
+    int line;
+    int firstColumn;
+    int lastColumn;
+};
+
+/// Counts of the nodes and edges of a graph by type, kept up to date as
+/// they are inserted so reading them is constant time.
+class GraphStats {
+    static const unsigned NUM_NODE_TYPES =
+        static_cast<unsigned>(NodeType::SignatureHub) + 1;
+    static const unsigned NUM_INST_TYPES =
+        static_cast<unsigned>(InstType::None) + 1;
+    static const unsigned NUM_PDG_TYPES =
+        static_cast<unsigned>(PDGType::None) + 1;
+
+    size_t _nodes;
+    size_t _edges;
+    size_t _nodeTypes[NUM_NODE_TYPES];
+    size_t _instTypes[NUM_INST_TYPES];
+    size_t _edgeTypes[NUM_EDGE_TYPES + 1];
+    size_t _pdgTypes[NUM_PDG_TYPES];
+
+public:
+    GraphStats()
+        : _nodes(0),
+          _edges(0),
+          _nodeTypes(),
+          _instTypes(),
+          _edgeTypes(),
+          _pdgTypes() {}
+
+    inline void addNode(const Node* node) {
+        _nodes++;
+        _nodeTypes[static_cast<unsigned>(node->type())]++;
+        if (node->type() == NodeType::Instruction) {
+            _instTypes[static_cast<unsigned>(node->instType())]++;
+        }
+    }
+    inline void addEdge(const Edge* edge) {
+        _edges++;
+        _edgeTypes[static_cast<unsigned>(edge->type())]++;
+        if (edge->type() == EdgeType::PDG) {
+            _pdgTypes[static_cast<unsigned>(edge->pdgType())]++;
+        }
+    }
+
+    inline size_t nodes() const { return _nodes; }
+    inline size_t nodes(NodeType type) const {
+        return _nodeTypes[static_cast<unsigned>(type)];
+    }
+    inline size_t insts(InstType type) const {
+        return _instTypes[static_cast<unsigned>(type)];
+    }
+    inline size_t edges() const { return _edges; }
+    inline size_t edges(EdgeType type) const {
+        return _edgeTypes[static_cast<unsigned>(type)];
+    }
+    inline size_t edges(PDGType type) const {
+        return _pdgTypes[static_cast<unsigned>(type)];
+    }
+
+    friend void to_json(json& j, const GraphStats& stats);
+};
+
+/// Bytes held by a graph, by category.
+struct GraphMemory {
+    /// Node objects, the tables of nodes and their source locations.
+    size_t nodes = 0;
+    /// Edge objects.
+    size_t edges = 0;
+    /// Interned names and labels, and the constants of PDG Const edges.
+    size_t labels = 0;
+    /// Per node edge arrays, the PDG edge keys and the frozen CSR index.
+    size_t adjacency = 0;
+    /// Property columns and AST numbering used by queries.
+    size_t queryCaches = 0;
+
+    inline size_t total() const {
+        return nodes + edges + labels + adjacency + queryCaches;
+    }
+
+    friend void to_json(json& j, const GraphMemory& m) {
+        j = json{{"nodes", m.nodes},
+                 {"edges", m.edges},
+                 {"labels", m.labels},
+                 {"adjacency", m.adjacency},
+                 {"queryCaches", m.queryCaches},
+                 {"total", m.total()}};
+    }
+};
+
+/// Nodes, AST and CFG edges made apart from a graph, so that parts of a
+/// graph can be built on several threads. A buffer interns strings in a
+/// table of its own and takes its nodes from an arena of the thread building
+/// it. Ids, graph symbols and edges are given by Graph::merge in the order
+/// the buffer recorded, so merging buffers in a fixed order yields the same
+/// graph whichever threads filled them.
+class GraphBuffer {
+    struct PendingEdge {
+        Node* src;
+        // Null for the trap node of the graph.
+        Node* dest;
+        EdgeType type;
+        Symbol label;
+    };
+
+    Arena<Node>& _arena;
+    StringTable _strings;
+    std::vector<Node*> _created;
+    std::vector<Node*> _inserted;
+    std::vector<PendingEdge> _edges;
+    std::vector<std::pair<const Node*, NodeLocation>> _locations;
+
+    friend class Graph;
+
+public:
+    /// The nodes are made in arena, which the graph must adopt after the
+    /// buffer is merged, see Graph::adoptNodes.
+    explicit GraphBuffer(Arena<Node>& arena) : _arena(arena) {}
+    GraphBuffer(const GraphBuffer&) = delete;
+    GraphBuffer& operator=(const GraphBuffer&) = delete;
+
+    template <class T, class... Args>
+    inline T* newNode(Args&&... args) {
+        T* node = _arena.make<T>(std::forward<Args>(args)...);
+        _created.push_back(node);
+        return node;
+    }
+
+    inline void insertNode(Node* node) { _inserted.push_back(node); }
+
+    template <class T>
+    inline void newEdge(Node* src, Node* dest) {
+        static_assert(std::is_same<T, ASTEdge>::value ||
+                          std::is_same<T, CFGEdge>::value,
+                      "buffers only hold AST and CFG edges");
+        EdgeType type =
+            std::is_same<T, ASTEdge>::value ? EdgeType::AST : EdgeType::CFG;
+        _edges.push_back({src, dest, type, Symbol()});
+    }
+
+    template <class T>
+    inline void newEdge(Node* src, Node* dest, const std::string& label) {
+        static_assert(std::is_same<T, CFGEdge>::value,
+                      "only CFG edges have a label");
+        _edges.push_back({src, dest, EdgeType::CFG, intern(label)});
+    }
+
+    /// CFG edge to the trap node of the graph, which is made on merge if the
+    /// graph has none yet.
+    inline void newTrapEdge(Node* src) {
+        _edges.push_back({src, nullptr, EdgeType::CFG, Symbol()});
+    }
+
+    inline Symbol intern(const std::string& str) {
+        return _strings.intern(str);
+    }
+
+    inline void setLocation(const Node* node, const Location& loc) {
+        NodeLocation entry;
+        entry.node = 0;
+        entry.filename =
+            intern(std::string(loc.filename.begin(), loc.filename.end()));
+        entry.line = loc.line;
+        entry.firstColumn = loc.first_column;
+        entry.lastColumn = loc.last_column;
+        _locations.emplace_back(node, entry);
+    }
+
+    inline size_t getMemoryUsage() const {
+        return _strings.getMemoryUsage() + memory::heapBytes(_created) +
+               memory::heapBytes(_inserted) + memory::heapBytes(_edges) +
+               memory::heapBytes(_locations);
+    }
 };
 
 class Graph {
     wabt::ModuleContext _mc;
+    Arena<Node> _nodeArena;
+    Arena<Edge> _edgeArena;
     std::vector<Node*> _nodes;
+    std::vector<Node*> _byId;
+    StringTable _strings;
+    std::unique_ptr<FrozenIndex> _frozen;
+    std::unique_ptr<BasicBlocks> _blocks;
+    std::unique_ptr<PropertyColumns> _columns;
+    std::unique_ptr<ASTIntervals> _intervals;
+    GraphStats _stats;
+    ConstantPool _constants;
+    std::vector<NodeLocation> _locations;
     Trap* _trap;
     Start* _start;
     Module* _module;
+    bool _sealed;
+    // Functions left to the materializer, by id of their Function node.
+    std::function<void(Node*)> _materializer;
+    std::vector<bool> _deferred;
+    Index _numDeferred;
+
+    void addLocation(const NodeLocation& entry);
 
 public:
-    Graph() : _mc(ModuleContext({})), _trap(nullptr), _start(nullptr) {}
+    Graph()
+        : _mc(ModuleContext({})),
+          _trap(nullptr),
+          _start(nullptr),
+          _module(nullptr),
+          _sealed(false),
+          _numDeferred(0) {}
     Graph(wabt::Module& mc)
-        : _mc(ModuleContext(mc)), _trap(nullptr), _start(nullptr) {}
+        : _mc(ModuleContext(mc)),
+          _trap(nullptr),
+          _start(nullptr),
+          _module(nullptr),
+          _sealed(false),
+          _numDeferred(0) {}
     ~Graph() {
-        for (auto node : _nodes) {
-            delete node;
+        // Nodes and edges live in the arenas, only the members of the nodes
+        // need to be released before the pages are dropped. Edges are plain
+        // records.
+        for (auto node : _byId) {
+            node->~Node();
         }
     }
 
-    inline void setTrap(Trap* trap) { _trap = trap; }
-    inline void setStart(Start* start) { _start = start; }
+    /// Allocates a node owned by this graph and gives it the next id. It
+    /// still has to be inserted with insertNode.
+    template <class T, class... Args>
+    inline T* newNode(Args&&... args) {
+        assert(!_sealed);
+        T* node = _nodeArena.make<T>(std::forward<Args>(args)...);
+        node->_id = static_cast<Index>(_byId.size());
+        node->_graph = this;
+        _byId.push_back(node);
+        _columns.reset();
+        return node;
+    }
+
+    inline Symbol intern(const std::string& str) {
+        assert(!_sealed);
+        return _strings.intern(str);
+    }
+    inline const StringTable& strings() const { return _strings; }
+
+    inline Index internConstant(const Const& value) {
+        assert(!_sealed);
+        return _constants.intern(value, _strings);
+    }
+    inline const ConstantPool& constants() const { return _constants; }
+
+    /// Node of this graph with the given id, null if there is none.
+    inline Node* nodeById(Index id) const {
+        return id < _byId.size() ? _byId[id] : nullptr;
+    }
+
+    /// Allocates an edge owned by this graph and links it to its endpoints.
+    template <class T, class... Args>
+    inline T* newEdge(Args&&... args) {
+        assert(!_sealed);
+        _frozen.reset();
+        T* edge = _edgeArena.make<T>(std::forward<Args>(args)...);
+        edge->src()->addOutEdge(edge);
+        edge->dest()->addInEdge(edge);
+        _stats.addEdge(edge);
+        if (edge->type() == EdgeType::AST) {
+            _intervals.reset();
+        } else if (edge->type() == EdgeType::CFG) {
+            _blocks.reset();
+        }
+        return edge;
+    }
+
+    /// Gives ids, in recording order, to the nodes of buffer and adds them,
+    /// their edges and their locations to this graph.
+    void merge(GraphBuffer& buffer);
+    /// Takes over the pages of an arena that buffers made nodes in.
+    inline void adoptNodes(Arena<Node>& arena) { _nodeArena.adopt(arena); }
+
+    /// Records the source location of a node of this graph. Nodes are
+    /// expected in creation order, which keeps the table sorted by appending.
+    void setLocation(const Node* node, const Location& loc);
+    /// Source location recorded for node, or an empty one.
+    Location location(const Node* node) const;
+
+    /// Numbers the AST below the module, unless it is not a tree. Adding AST
+    /// edges afterwards drops the numbering.
+    void numberAST();
+    inline const ASTIntervals* getASTIntervals() const {
+        return _intervals.get();
+    }
+
+    /// Builds the CSR index and the property columns used by queries, and
+    /// numbers the AST if it is not yet. Adding nodes or edges afterwards
+    /// drops the index, adding nodes drops the columns.
+    void freeze();
+    inline const FrozenIndex* getFrozenIndex() const { return _frozen.get(); }
+    /// Groups the CFG into basic blocks, see getBasicBlocks. The PDG builder
+    /// walks them, so the tools call this as soon as the CFG is built.
+    void indexBasicBlocks();
+    /// Basic blocks of the CFG, built by indexBasicBlocks, or by freeze when
+    /// cpgOptions.basicBlocks is set. Adding CFG edges drops them.
+    inline const BasicBlocks* getBasicBlocks() const { return _blocks.get(); }
+    inline const PropertyColumns* getColumns() const { return _columns.get(); }
+
+    /// Freezes the graph for the last time. Any later change is an error,
+    /// see GraphSnapshot. A graph with deferred functions cannot be sealed.
+    void seal();
+    inline bool isSealed() const { return _sealed; }
+
+    /// Leaves every function of the module to be completed by materializer
+    /// the first time the edges of one of its instructions are read. A graph
+    /// with deferred functions is not given a CSR index and is not sealed
+    /// until materializeAll: it changes under its readers, so like any graph
+    /// still being built it is queried from the thread building it only.
+    void defer(std::function<void(Node*)> materializer);
+    /// Completes the function of node if it is deferred.
+    void materialize(const Node* node);
+    /// Completes every deferred function.
+    void materializeAll();
+    inline bool hasDeferred() const { return _numDeferred != 0; }
+
+    inline void setTrap(Trap* trap) {
+        assert(!_sealed);
+        _trap = trap;
+    }
+    inline void setStart(Start* start) {
+        assert(!_sealed);
+        _start = start;
+    }
     inline void setModule(Module* module) {
-        assert(module != nullptr);
+        assert(!_sealed && module != nullptr);
         _module = module;
     }
-    inline void insertNode(Node* node) { _nodes.push_back(node); }
+    inline void insertNode(Node* node) {
+        assert(!_sealed);
+        _frozen.reset();
+        _nodes.push_back(node);
+        _stats.addNode(node);
+    }
     inline const std::vector<Node*>& getNodes() const { return _nodes; }
     inline wabt::ModuleContext& getModuleContext() { return _mc; }
     inline Trap* getTrap() {
         if (_trap == nullptr) {
-            _trap = new Trap();
+            _trap = newNode<Trap>();
             this->insertNode(_trap);
         }
         return _trap;
     }
     inline Start* getStart() {
         if (_start == nullptr) {
-            _start = new Start();
+            _start = newNode<Start>();
             this->insertNode(_start);
         }
         return _start;
@@ -742,26 +1453,265 @@ public:
         return _module;
     }
 
-    inline size_t getNumberNodes() { return _nodes.size(); }
+    inline size_t getNumberNodes() const { return _stats.nodes(); }
+    inline size_t getNumberEdges() const { return _stats.edges(); }
+    inline const GraphStats& getStats() const { return _stats; }
+
+    GraphMemory getMemory() const;
+    inline size_t getMemoryUsage() const { return getMemory().total(); }
+
+    inline json getArenaUsage() const {
+        auto usage = [](size_t objects, size_t pages, size_t reserved,
+                        size_t used) {
+            return json{{"objects", objects},
+                        {"pages", pages},
+                        {"reserved", reserved},
+                        {"used", used}};
+        };
+        return json{{"nodes", usage(_nodeArena.numObjects(),
+                                    _nodeArena.numPages(),
+                                    _nodeArena.bytesReserved(),
+                                    _nodeArena.bytesUsed())},
+                    {"edges", usage(_edgeArena.numObjects(),
+                                    _edgeArena.numPages(),
+                                    _edgeArena.bytesReserved(),
+                                    _edgeArena.bytesUsed())}};
+    }
+};
 
-    inline size_t getNumberEdges() {
-        size_t edges = 0;
-        for (Node* node : _nodes) {
-            edges += node->outEdges().size();
+// Materializes the deferred PDG of the function of the node.
+inline void Node::complete() const {
+    // Only instructions get edges when a function is completed.
+    if (_graph != nullptr && _graph->hasDeferred() &&
+        _type == NodeType::Instruction) {
+        _graph->materialize(this);
+    }
+}
+
+/// Read-only handle on a sealed graph. Sealing builds the CSR index, the
+/// property columns and the AST numbering one last time, after which the
+/// graph, its nodes and its edges are never written again. A graph with
+/// deferred functions writes its edges as it is read, so it cannot be
+/// sealed nor given a snapshot.
+///
+/// Thread safety: any number of threads may query the same snapshot at once
+/// without locking, each through its own QueryContext. What a thread creates
+/// while querying, such as NodeSets, Predicates and edge conditions, belongs
+/// to that thread: predicates and conditions cache symbol lookups and must
+/// not be shared between threads.
+class GraphSnapshot {
+    const Graph& _graph;
+
+public:
+    /// Seals graph, which must outlive the snapshot and have no deferred
+    /// functions.
+    explicit GraphSnapshot(Graph& graph) : _graph(graph) {
+        if (!graph.isSealed()) {
+            graph.seal();
         }
-        return edges;
     }
+    GraphSnapshot(const GraphSnapshot&) = delete;
+    GraphSnapshot& operator=(const GraphSnapshot&) = delete;
+
+    inline const Graph& graph() const { return _graph; }
+};
+
+/// Set of nodes iterated in ascending id order. Small sets are kept as a
+/// sorted vector; once a set is dense enough over its id range it switches
+/// to a bitset keyed by node id, so membership, union and intersection work
+/// a word at a time. Ids are only unique within a graph, so all the nodes
+/// of a set must belong to the same Graph, and nodes no graph owns yet are
+/// rejected. A node of another graph is never counted as a member.
+class NodeSet {
+    static const size_t SMALL_SIZE = 32;
+    static const Index WORD_BITS = 64;
+
+    std::vector<Node*> _small;
+    std::vector<uint64_t> _words;
+    Index _firstWord;
+    size_t _size;
+    const Graph* _graph;
 
-    inline size_t getMemoryUsage() {
-        size_t result = 0;
-        result += sizeof(*this);
-        for (Node* node : _nodes) {
-            result += sizeof(*node);
-            for (Edge* e : node->outEdges()) {
-                result += sizeof(*e);
+public:
+    class const_iterator {
+        const NodeSet* _set;
+        size_t _pos;
+        uint64_t _bits;
+
+        friend class NodeSet;
+        const_iterator(const NodeSet* set, size_t pos, uint64_t bits)
+            : _set(set), _pos(pos), _bits(bits) {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Node* value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Node* const* pointer;
+        typedef Node* reference;
+
+        const_iterator() : _set(nullptr), _pos(0), _bits(0) {}
+
+        inline Node* operator*() const {
+            if (_set->_graph == nullptr) {
+                return _set->_small[_pos];
+            }
+            return _set->_graph->nodeById(id());
+        }
+        inline const_iterator& operator++() {
+            if (_set->_graph == nullptr) {
+                _pos++;
+                return *this;
+            }
+            _bits &= _bits - 1;
+            while (_bits == 0 && ++_pos < _set->_words.size()) {
+                _bits = _set->_words[_pos];
             }
+            return *this;
+        }
+        /// Id of the current node. Dense sets do not touch the node.
+        inline Index id() const {
+            if (_set->_graph == nullptr) {
+                return _set->_small[_pos]->id();
+            }
+            Index word = _set->_firstWord + static_cast<Index>(_pos);
+            return word * WORD_BITS + countTrailingZeros(_bits);
+        }
+        inline const_iterator operator++(int) {
+            const_iterator it = *this;
+            ++*this;
+            return it;
         }
-        return result;
+        inline bool operator==(const const_iterator& other) const {
+            return _pos == other._pos && _bits == other._bits;
+        }
+        inline bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+    };
+    typedef const_iterator iterator;
+    typedef Node* value_type;
+    typedef size_t size_type;
+
+    NodeSet() : _firstWord(0), _size(0), _graph(nullptr) {}
+    NodeSet(std::initializer_list<Node*> nodes) : NodeSet() {
+        insert(nodes.begin(), nodes.end());
+    }
+    template <class InputIt>
+    NodeSet(InputIt first, InputIt last) : NodeSet() {
+        insert(first, last);
+    }
+
+    inline size_t size() const { return _size; }
+    inline bool empty() const { return _size == 0; }
+    /// True once the set is stored as a bitset.
+    inline bool dense() const { return _graph != nullptr; }
+    inline size_t heapBytes() const {
+        return memory::heapBytes(_small) + memory::heapBytes(_words);
+    }
+
+    const_iterator begin() const;
+    inline const_iterator end() const {
+        return dense() ? const_iterator(this, _words.size(), 0)
+                       : const_iterator(this, _small.size(), 0);
+    }
+    inline const_iterator cbegin() const { return begin(); }
+    inline const_iterator cend() const { return end(); }
+    /// Node with the smallest id. The set must not be empty.
+    inline Node* front() const {
+        assert(!empty());
+        return *begin();
+    }
+    /// Node with the largest id. The set must not be empty.
+    Node* back() const;
+
+    inline size_t count(const Node* node) const {
+        if (dense()) {
+            if (node->graph() != _graph) {
+                return 0;
+            }
+            Index word = node->id() / WORD_BITS;
+            if (word < _firstWord || word - _firstWord >= _words.size()) {
+                return 0;
+            }
+            return (_words[word - _firstWord] >> (node->id() % WORD_BITS)) & 1;
+        }
+        auto it = lowerBound(node->id());
+        return it != _small.end() && *it == node ? 1 : 0;
+    }
+
+    /// Returns true if the node was not in the set.
+    inline bool insert(Node* node) {
+        assert(node != nullptr && node->graph() != nullptr);
+        if (dense()) {
+            return insertBit(node);
+        }
+        assert(_small.empty() || _small.front()->graph() == node->graph());
+        auto it = lowerBound(node->id());
+        if (it != _small.end() && (*it)->id() == node->id()) {
+            return false;
+        }
+        _small.insert(it, node);
+        _size++;
+        if (_small.size() > SMALL_SIZE) {
+            densify();
+        }
+        return true;
+    }
+    template <class InputIt>
+    void insert(InputIt first, InputIt last) {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+    /// Returns true if the node was in the set.
+    bool erase(const Node* node);
+    void clear();
+
+    /// Adds every node of other to this set.
+    NodeSet& unite(const NodeSet& other);
+    /// Keeps only the nodes that are also in other.
+    NodeSet& intersect(const NodeSet& other);
+
+    bool operator==(const NodeSet& other) const;
+    inline bool operator!=(const NodeSet& other) const {
+        return !(*this == other);
+    }
+
+private:
+    inline std::vector<Node*>::const_iterator lowerBound(Index id) const {
+        return std::lower_bound(
+            _small.begin(), _small.end(), id,
+            [](const Node* node, Index id) { return node->id() < id; });
+    }
+
+    bool insertBit(Node* node);
+    void densify();
+    void countBits();
+
+    static inline Index countTrailingZeros(uint64_t bits) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return static_cast<Index>(index);
+#else
+        return static_cast<Index>(__builtin_ctzll(bits));
+#endif
+    }
+    static inline Index countLeadingZeros(uint64_t bits) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, bits);
+        return static_cast<Index>(63 - index);
+#else
+        return static_cast<Index>(__builtin_clzll(bits));
+#endif
+    }
+    static inline size_t popcount(uint64_t bits) {
+#if defined(_MSC_VER)
+        return static_cast<size_t>(__popcnt64(bits));
+#else
+        return static_cast<size_t>(__builtin_popcountll(bits));
+#endif
     }
 };
 
@@ -784,6 +1734,7 @@ public:
     virtual void visitElse(Else* node) = 0;
     virtual void visitStart(Start* node) = 0;
     virtual void visitTrap(Trap* node) = 0;
+    virtual void visitSignatureHub(SignatureHub* node) = 0;
     virtual void visitVarNode(VarNode* node) = 0;
     virtual void visitNopInst(NopInst* node) = 0;
     virtual void visitUnreachableInst(UnreachableInst* node) = 0;
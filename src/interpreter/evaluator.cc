@@ -139,8 +139,16 @@ std::map<std::string, Func> functionsMap = {
     {"descendantsCFG", Functions::descendantsCFG},
     {"descendantsAST", Functions::descendantsAST},
     {"reachesPDG", Functions::reachesPDG},
+    {"dominates", Functions::dominates},
+    {"postDominates", Functions::postDominates},
+    {"loops", Functions::loops},
+    {"loopHeader", Functions::loopHeader},
+    {"loopDepth", Functions::loopDepth},
+    {"loopBody", Functions::loopBody},
+    {"loopExits", Functions::loopExits},
     {"vulnerability", Functions::vulnerability},
     {"print_vulns", Functions::print_vulns},
+    {"stats", Functions::stats},
 
     {"range", Functions::range},
     {"print", Functions::print},
@@ -147,6 +147,95 @@ struct Functions {
         return nodeSetToList(lineno, nodes);
     }
 
+    static std::shared_ptr<LiteralNode> dominates(
+        int lineno,
+        std::shared_ptr<ListNode> args) {
+        ASSERT_NUM_ARGS_(args, 2);
+        ASSERT_EXPR_TYPE_(args->value()->node(0), LiteralType::Node);
+        ASSERT_EXPR_TYPE_(args->value()->node(1), LiteralType::Node);
+        auto a = std::dynamic_pointer_cast<NodePointer>(args->value()->node(0));
+        auto b = std::dynamic_pointer_cast<NodePointer>(args->value()->node(1));
+
+        return std::make_shared<BoolNode>(
+            lineno, Query::dominates(a->value(), b->value()));
+    }
+
+    static std::shared_ptr<LiteralNode> postDominates(
+        int lineno,
+        std::shared_ptr<ListNode> args) {
+        ASSERT_NUM_ARGS_(args, 2);
+        ASSERT_EXPR_TYPE_(args->value()->node(0), LiteralType::Node);
+        ASSERT_EXPR_TYPE_(args->value()->node(1), LiteralType::Node);
+        auto a = std::dynamic_pointer_cast<NodePointer>(args->value()->node(0));
+        auto b = std::dynamic_pointer_cast<NodePointer>(args->value()->node(1));
+
+        return std::make_shared<BoolNode>(
+            lineno, Query::postDominates(a->value(), b->value()));
+    }
+
+    static std::shared_ptr<LiteralNode> loops(
+        int lineno,
+        std::shared_ptr<ListNode> args) {
+        ASSERT_NUM_ARGS_(args, 1);
+        ASSERT_EXPR_TYPE_(args->value()->node(0), LiteralType::Node);
+        auto func =
+            std::dynamic_pointer_cast<NodePointer>(args->value()->node(0));
+
+        auto nodes = Query::loops({func->value()});
+        return nodeSetToList(lineno, nodes);
+    }
+
+    static std::shared_ptr<LiteralNode> loopHeader(
+        int lineno,
+        std::shared_ptr<ListNode> args) {
+        ASSERT_NUM_ARGS_(args, 1);
+        ASSERT_EXPR_TYPE_(args->value()->node(0), LiteralType::Node);
+        auto node =
+            std::dynamic_pointer_cast<NodePointer>(args->value()->node(0));
+
+        Node* header = Query::loopHeader(node->value());
+        if (header != nullptr) {
+            return std::make_shared<NodePointer>(lineno, header);
+        }
+        return NIL(lineno);
+    }
+
+    static std::shared_ptr<LiteralNode> loopDepth(
+        int lineno,
+        std::shared_ptr<ListNode> args) {
+        ASSERT_NUM_ARGS_(args, 1);
+        ASSERT_EXPR_TYPE_(args->value()->node(0), LiteralType::Node);
+        auto node =
+            std::dynamic_pointer_cast<NodePointer>(args->value()->node(0));
+
+        return std::make_shared<IntNode>(lineno,
+                                         Query::loopDepth(node->value()));
+    }
+
+    static std::shared_ptr<LiteralNode> loopBody(
+        int lineno,
+        std::shared_ptr<ListNode> args) {
+        ASSERT_NUM_ARGS_(args, 1);
+        ASSERT_EXPR_TYPE_(args->value()->node(0), LiteralType::Node);
+        auto header =
+            std::dynamic_pointer_cast<NodePointer>(args->value()->node(0));
+
+        auto nodes = Query::loopBody(header->value());
+        return nodeSetToList(lineno, nodes);
+    }
+
+    static std::shared_ptr<LiteralNode> loopExits(
+        int lineno,
+        std::shared_ptr<ListNode> args) {
+        ASSERT_NUM_ARGS_(args, 1);
+        ASSERT_EXPR_TYPE_(args->value()->node(0), LiteralType::Node);
+        auto header =
+            std::dynamic_pointer_cast<NodePointer>(args->value()->node(0));
+
+        auto edges = Query::loopExits(header->value());
+        return edgeSetToList(lineno, edges);
+    }
+
     static std::shared_ptr<LiteralNode> reachesPDG(
         int lineno,
         std::shared_ptr<ListNode> args) {
@@ -222,6 +311,26 @@ struct Functions {
         return NONE(lineno);
     }
 
+    static std::shared_ptr<MapNode> countsToMap(int lineno,
+                                                const json& counts) {
+        auto map = std::make_shared<MapNode>(lineno);
+        for (auto it = counts.begin(); it != counts.end(); ++it) {
+            if (it.value().is_object()) {
+                map->value()[it.key()] = countsToMap(lineno, it.value());
+            } else {
+                map->value()[it.key()] =
+                    std::make_shared<IntNode>(lineno, it.value().get<int>());
+            }
+        }
+        return map;
+    }
+
+    static std::shared_ptr<LiteralNode> stats(int lineno,
+                                              std::shared_ptr<ListNode> args) {
+        json counts = Query::stats();
+        return countsToMap(lineno, counts);
+    }
+
     static std::shared_ptr<LiteralNode> range(int lineno,
                                               std::shared_ptr<ListNode> args) {
         ASSERT_NUM_ARGS_(args, 1);
@@ -1171,7 +1280,7 @@ public:
         int lineno,
         std::shared_ptr<LiteralNode> expr) {
         auto node = std::dynamic_pointer_cast<NodePointer>(expr);
-        auto edges = node->value()->inEdges();
+        auto edges = Query::edges(node->value(), true);
         return Functions::edgeSetToList(lineno, edges);
     }
 
@@ -1179,7 +1288,7 @@ public:
         int lineno,
         std::shared_ptr<LiteralNode> expr) {
         auto node = std::dynamic_pointer_cast<NodePointer>(expr);
-        auto edges = node->value()->outEdges();
+        auto edges = Query::edges(node->value(), false);
         return Functions::edgeSetToList(lineno, edges);
     }
 
@@ -1190,8 +1299,8 @@ public:
         std::shared_ptr<LiteralNode> expr,
         std::shared_ptr<ListNode> parameters) {
         auto node = std::dynamic_pointer_cast<NodePointer>(expr);
-        auto inEdges = node->value()->inEdges();
-        auto outEdges = node->value()->outEdges();
+        auto inEdges = Query::edges(node->value(), true);
+        auto outEdges = Query::edges(node->value(), false);
         inEdges.insert(outEdges.begin(), outEdges.end());
         return Functions::edgeSetToList(lineno, inEdges);
     }
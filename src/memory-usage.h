@@ -0,0 +1,91 @@
+#ifndef WASMATI_MEMORY_USAGE_H
+#define WASMATI_MEMORY_USAGE_H
+#include <cstddef>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace wasmati {
+
+/// Estimates of the heap bytes held by standard containers. Only the storage
+/// of the container itself is counted, what its elements own on the heap has
+/// to be added by the caller.
+namespace memory {
+
+/// Bytes a node based container spends on every element besides the element
+/// itself: the links between nodes and the allocator header.
+const size_t NODE_OVERHEAD = 4 * sizeof(void*);
+
+inline size_t heapBytes(const std::string& str) {
+    // Short strings are stored inline in the object.
+    const char* data = str.data();
+    const char* object = reinterpret_cast<const char*>(&str);
+    bool inline_ = data >= object && data < object + sizeof(std::string);
+    return inline_ ? 0 : str.capacity() + 1;
+}
+
+template <class T, class A>
+inline size_t heapBytes(const std::vector<T, A>& vec) {
+    return vec.capacity() * sizeof(T);
+}
+
+template <class T, class A>
+inline size_t heapBytes(const std::list<T, A>& list) {
+    return list.size() * (sizeof(T) + NODE_OVERHEAD);
+}
+
+template <class T, class C, class A>
+inline size_t heapBytes(const std::set<T, C, A>& set) {
+    return set.size() * (sizeof(T) + NODE_OVERHEAD);
+}
+
+template <class K, class V, class C, class A>
+inline size_t heapBytes(const std::map<K, V, C, A>& map) {
+    typedef typename std::map<K, V, C, A>::value_type Entry;
+    return map.size() * (sizeof(Entry) + NODE_OVERHEAD);
+}
+
+template <class K, class V, class H, class E, class A>
+inline size_t heapBytes(const std::unordered_map<K, V, H, E, A>& map) {
+    typedef typename std::unordered_map<K, V, H, E, A>::value_type Entry;
+    return map.size() * (sizeof(Entry) + NODE_OVERHEAD) +
+           map.bucket_count() * sizeof(void*);
+}
+
+template <class T, class H, class E, class A>
+inline size_t heapBytes(const std::unordered_set<T, H, E, A>& set) {
+    return set.size() * (sizeof(T) + NODE_OVERHEAD) +
+           set.bucket_count() * sizeof(void*);
+}
+
+/// Highest resident set size of the process so far, in bytes. Returns 0
+/// where the platform does not report it.
+inline size_t peakRSS() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    // Linux reports kilobytes.
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+}  // namespace memory
+}  // namespace wasmati
+
+#endif /* WASMATI_MEMORY_USAGE_H */
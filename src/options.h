@@ -30,6 +30,17 @@ struct GenerateCPGOptions {
     bool verbose = false;
     bool info = false;
     std::string loopName;
+    /// Threads used to build the graph, 0 for one per hardware thread.
+    unsigned threads = 1;
+    /// Free every function body from the module once its graph is built.
+    bool stream = false;
+    /// Build the PDG of a function only once a query reads it.
+    bool lazy = false;
+    /// Group the CFG into basic blocks once it is built.
+    bool basicBlocks = false;
+    /// Link every call_indirect to a SignatureHub of its table and type
+    /// instead of to every function it may call.
+    bool signatureHubs = false;
 };
 
 extern json info;
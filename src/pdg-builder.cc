@@ -5,6 +5,7 @@ void PDG::generatePDG() {
     if (!cpgOptions.loopName.empty()) {
         _verboseLoops = Queries::loopsInsts(cpgOptions.loopName);
     }
+    assert(graph.getASTIntervals() != nullptr);
     Index counter = 0;
     for (Node* func : Query::functions()) {
         if (func->isImport()) {
@@ -12,149 +13,205 @@ void PDG::generatePDG() {
         }
         debug("[DEBUG][PDG][%u/%lu] Function %s\n", counter++,
               mc.module.funcs.size(), func->name().c_str());
+        generateFunction(func);
+    }
+}
 
-        currentFunction = func->getFunc();
-
-        auto filterInsts =
-            NodeStream(func).children(Query::AST_EDGES).filter([](Node* n) {
-                return n->type() == NodeType::Instructions;
-            });
-        assert(filterInsts.size() == 1);
-
-        // clear
-        _reachDef.clear();
-        _loops.clear();
-        _loopsInsts.clear();
-        _loopsStack = std::stack<LoopInst*>();
-        _loopsEntrances.clear();
-
-        visitInstructions(
-            dynamic_cast<Instructions*>(filterInsts.findFirst().get()));
-
-        while (_dfsList.size() != 0) {
-            auto firstInst = _dfsList.front();
-            _dfsList.pop_front();
-
-            // set loopsStack
-            _loopsStack = *(std::get<1>(firstInst));
-            // set last node
-            _lastNode = std::get<2>(firstInst);
-
-            switch (std::get<0>(firstInst)->instType()) {
-            case InstType::Nop:
-                visitNopInst(dynamic_cast<NopInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Unreachable:
-                visitUnreachableInst(
-                    dynamic_cast<UnreachableInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Return:
-                visitReturnInst(
-                    dynamic_cast<ReturnInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::BrTable:
-                visitBrTableInst(
-                    dynamic_cast<BrTableInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::CallIndirect:
-                visitCallIndirectInst(
-                    dynamic_cast<CallIndirectInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Drop:
-                visitDropInst(dynamic_cast<DropInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Select:
-                visitSelectInst(
-                    dynamic_cast<SelectInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::MemorySize:
-                visitMemorySizeInst(
-                    dynamic_cast<MemorySizeInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::MemoryGrow:
-                visitMemoryGrowInst(
-                    dynamic_cast<MemoryGrowInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Const:
-                visitConstInst(
-                    dynamic_cast<ConstInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Binary:
-                visitBinaryInst(
-                    dynamic_cast<BinaryInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Compare:
-                visitCompareInst(
-                    dynamic_cast<CompareInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Convert:
-                visitConvertInst(
-                    dynamic_cast<ConvertInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Unary:
-                visitUnaryInst(
-                    dynamic_cast<UnaryInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Load:
-                visitLoadInst(dynamic_cast<LoadInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Store:
-                visitStoreInst(
-                    dynamic_cast<StoreInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Br:
-                visitBrInst(dynamic_cast<BrInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::BrIf:
-                visitBrIfInst(dynamic_cast<BrIfInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Call:
-                visitCallInst(dynamic_cast<CallInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::GlobalGet:
-                visitGlobalGetInst(
-                    dynamic_cast<GlobalGetInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::GlobalSet:
-                visitGlobalSetInst(
-                    dynamic_cast<GlobalSetInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::LocalGet:
-                visitLocalGetInst(
-                    dynamic_cast<LocalGetInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::LocalSet:
-                visitLocalSetInst(
-                    dynamic_cast<LocalSetInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::LocalTee:
-                visitLocalTeeInst(
-                    dynamic_cast<LocalTeeInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::BeginBlock:
-                visitBeginBlockInst(
-                    dynamic_cast<BeginBlockInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Block:
-                visitBlockInst(
-                    dynamic_cast<BlockInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::Loop:
-                visitLoopInst(dynamic_cast<LoopInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::EndLoop:
-                visitEndLoopInst(
-                    dynamic_cast<EndLoopInst*>(std::get<0>(firstInst)));
-                break;
-            case InstType::If:
-                visitIfInst(dynamic_cast<IfInst*>(std::get<0>(firstInst)));
-                break;
-            default:
-                assert(false);
-                break;
+std::shared_ptr<PDG> PDG::defer(ModuleContext& mc, Graph& graph) {
+    auto pdg = std::make_shared<PDG>(mc, graph);
+    if (!cpgOptions.loopName.empty()) {
+        pdg->_verboseLoops = Queries::loopsInsts(cpgOptions.loopName);
+    }
+    graph.defer([pdg](Node* func) {
+        debug("[DEBUG][PDG] Function %s\n", func->name().c_str());
+        pdg->generateFunction(func);
+    });
+    return pdg;
+}
+
+void PDG::generateFunction(Node* func) {
+    assert(graph.getASTIntervals() != nullptr);
+    currentFunction = func->getFunc();
+
+    auto filterInsts =
+        NodeStream(func).children(Query::AST_EDGES).filter([](Node* n) {
+            return n->type() == NodeType::Instructions;
+        });
+    assert(filterInsts.size() == 1);
+
+    // clear
+    _reachDef.clear();
+    _loops.clear();
+    _loopsBlocks.clear();
+    _loopsStack = std::stack<LoopInst*>();
+    _loopsEntrances.clear();
+    _pdgEdges.clear();
+    _pdgEdges.reserve(graph.getASTIntervals()->descendants(func).size());
+
+    visitInstructions(
+        dynamic_cast<Instructions*>(filterInsts.findFirst().get()));
+
+    while (_dfsList.size() != 0) {
+        auto firstInst = _dfsList.front();
+        _dfsList.pop_front();
+
+        // set loopsStack
+        _loopsStack = *(std::get<1>(firstInst));
+        // set last node
+        _lastNode = std::get<2>(firstInst);
+
+        // The rest of a basic block is visited right away, see advance.
+        for (Node* inst = std::get<0>(firstInst); inst != nullptr;) {
+            _next = nullptr;
+            visit(inst);
+            if (_next != nullptr) {
+                _lastNode = inst;
             }
+            inst = _next;
+        }
+    }
+    if (cpgOptions.info) {
+        _peakMemory = std::max(_peakMemory, getMemoryUsage());
+    }
+}
+
+void PDG::visit(Node* inst) {
+    switch (inst->instType()) {
+    case InstType::Nop:
+        visitNopInst(dynamic_cast<NopInst*>(inst));
+        break;
+    case InstType::Unreachable:
+        visitUnreachableInst(dynamic_cast<UnreachableInst*>(inst));
+        break;
+    case InstType::Return:
+        visitReturnInst(dynamic_cast<ReturnInst*>(inst));
+        break;
+    case InstType::BrTable:
+        visitBrTableInst(dynamic_cast<BrTableInst*>(inst));
+        break;
+    case InstType::CallIndirect:
+        visitCallIndirectInst(dynamic_cast<CallIndirectInst*>(inst));
+        break;
+    case InstType::Drop:
+        visitDropInst(dynamic_cast<DropInst*>(inst));
+        break;
+    case InstType::Select:
+        visitSelectInst(dynamic_cast<SelectInst*>(inst));
+        break;
+    case InstType::MemorySize:
+        visitMemorySizeInst(dynamic_cast<MemorySizeInst*>(inst));
+        break;
+    case InstType::MemoryGrow:
+        visitMemoryGrowInst(dynamic_cast<MemoryGrowInst*>(inst));
+        break;
+    case InstType::Const:
+        visitConstInst(dynamic_cast<ConstInst*>(inst));
+        break;
+    case InstType::Binary:
+        visitBinaryInst(dynamic_cast<BinaryInst*>(inst));
+        break;
+    case InstType::Compare:
+        visitCompareInst(dynamic_cast<CompareInst*>(inst));
+        break;
+    case InstType::Convert:
+        visitConvertInst(dynamic_cast<ConvertInst*>(inst));
+        break;
+    case InstType::Unary:
+        visitUnaryInst(dynamic_cast<UnaryInst*>(inst));
+        break;
+    case InstType::Load:
+        visitLoadInst(dynamic_cast<LoadInst*>(inst));
+        break;
+    case InstType::Store:
+        visitStoreInst(dynamic_cast<StoreInst*>(inst));
+        break;
+    case InstType::Br:
+        visitBrInst(dynamic_cast<BrInst*>(inst));
+        break;
+    case InstType::BrIf:
+        visitBrIfInst(dynamic_cast<BrIfInst*>(inst));
+        break;
+    case InstType::Call:
+        visitCallInst(dynamic_cast<CallInst*>(inst));
+        break;
+    case InstType::GlobalGet:
+        visitGlobalGetInst(dynamic_cast<GlobalGetInst*>(inst));
+        break;
+    case InstType::GlobalSet:
+        visitGlobalSetInst(dynamic_cast<GlobalSetInst*>(inst));
+        break;
+    case InstType::LocalGet:
+        visitLocalGetInst(dynamic_cast<LocalGetInst*>(inst));
+        break;
+    case InstType::LocalSet:
+        visitLocalSetInst(dynamic_cast<LocalSetInst*>(inst));
+        break;
+    case InstType::LocalTee:
+        visitLocalTeeInst(dynamic_cast<LocalTeeInst*>(inst));
+        break;
+    case InstType::BeginBlock:
+        visitBeginBlockInst(dynamic_cast<BeginBlockInst*>(inst));
+        break;
+    case InstType::Block:
+        visitBlockInst(dynamic_cast<BlockInst*>(inst));
+        break;
+    case InstType::Loop:
+        visitLoopInst(dynamic_cast<LoopInst*>(inst));
+        break;
+    case InstType::EndLoop:
+        visitEndLoopInst(dynamic_cast<EndLoopInst*>(inst));
+        break;
+    case InstType::If:
+        visitIfInst(dynamic_cast<IfInst*>(inst));
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+size_t PDG::getMemoryUsage() const {
+    std::set<const void*> seen;
+    auto reachDefBytes = [&](const std::shared_ptr<ReachDefinition>& def) {
+        if (!seen.insert(def.get()).second) {
+            return size_t(0);
+        }
+        return sizeof(ReachDefinition) + def->heapBytes(seen);
+    };
+    size_t result = memory::heapBytes(_dfsList);
+    for (auto const& entry : _dfsList) {
+        auto& stack = std::get<1>(entry);
+        if (seen.insert(stack.get()).second) {
+            result += sizeof(*stack) + stack->size() * sizeof(LoopInst*);
+        }
+    }
+    result += memory::heapBytes(_reachDef);
+    for (auto const& kv : _reachDef) {
+        result += memory::heapBytes(kv.second);
+        for (auto const& def : kv.second) {
+            result += reachDefBytes(def);
+        }
+    }
+    result += memory::heapBytes(_loopsEntrances);
+    for (auto const& kv : _loopsEntrances) {
+        result += memory::heapBytes(kv.second);
+        for (auto const& def : kv.second) {
+            result += reachDefBytes(def);
+        }
+    }
+    for (auto map : {&_loops, &_cacheDefloops}) {
+        result += memory::heapBytes(*map);
+        for (auto const& kv : *map) {
+            result += reachDefBytes(kv.second);
         }
     }
+    result += memory::heapBytes(_pdgEdges);
+    result += memory::heapBytes(_loopsBlocks);
+    for (auto const& kv : _loopsBlocks) {
+        result += kv.second.heapBytes();
+    }
+    result += _loopsStack.size() * sizeof(LoopInst*);
+    return result;
 }
 
 void PDG::visitCFGEdge(Edge* e, std::shared_ptr<std::stack<LoopInst*>> stack) {
@@ -173,14 +230,13 @@ void PDG::visitInstructions(Instructions* node) {
         reachDefs->insertLocal(local.first);
     }
 
-    auto outEdges = EdgeStream(node->outEdges(EdgeType::CFG));
+    auto outEdges = node->outEdges(EdgeType::CFG);
     assert(outEdges.size() == 1);
-    auto first = outEdges.findFirst();
+    Edge* first = outEdges[0];
 
-    _reachDef[first.get()->dest()].insert(reachDefs);
+    _reachDef[first->dest()].insert(reachDefs);
 
-    visitCFGEdge(first.get(),
-                 std::make_shared<std::stack<LoopInst*>>(_loopsStack));
+    visitCFGEdge(first, std::make_shared<std::stack<LoopInst*>>(_loopsStack));
 }
 
 void PDG::visitNopInst(NopInst* node) {
@@ -213,7 +269,7 @@ void PDG::visitReturnInst(ReturnInst* node) {
     assert(reachDef->stackSize() <= 1);
     assert(currentFunction->GetNumResults() == reachDef->stackSize());
     if (reachDef->stackSize() == 1) {
-        reachDef->peek()->insertPDGEdge(node);
+        reachDef->peek()->insertPDGEdge(graph, _pdgEdges, node);
     }
     // ---------------------------------------
     advance(node, reachDef);
@@ -229,7 +285,7 @@ void PDG::visitBrTableInst(BrTableInst* node) {
     assert(reachDef->stackSize() >= 1);
 
     auto arg = reachDef->pop();
-    arg->insertPDGEdge(node);
+    arg->insertPDGEdge(graph, _pdgEdges, node);
 
     // ---------------------------------------
     advance(node, reachDef);
@@ -263,7 +319,7 @@ void PDG::visitSelectInst(SelectInst* node) {
 
     // selects works: if c = 0 then val2 else val1
     // select depends on c, the following instructions will depend val1 and val2
-    c->insertPDGEdge(node);
+    c->insertPDGEdge(graph, _pdgEdges, node);
 
     // union of vals and push
     val1->unionDef(val2);
@@ -295,7 +351,7 @@ void PDG::visitMemoryGrowInst(MemoryGrowInst* node) {
 
     auto n = reachDef->pop();
     // this inst depends on n
-    n->insertPDGEdge(node);
+    n->insertPDGEdge(graph, _pdgEdges, node);
 
     // memory.grow pushes new size of memory if OK or else an error number
     reachDef->push();
@@ -329,7 +385,7 @@ void PDG::visitBinaryInst(BinaryInst* node) {
     auto arg1 = reachDef->pop();
     auto arg2 = reachDef->pop();
     arg1->unionDef(arg2);
-    arg1->insertPDGEdge(node);
+    arg1->insertPDGEdge(graph, _pdgEdges, node);
     arg1->removeConsts();
     arg1->clear(node);
     reachDef->push(arg1);
@@ -348,7 +404,7 @@ void PDG::visitCompareInst(CompareInst* node) {
     auto arg1 = reachDef->pop();
     auto arg2 = reachDef->pop();
     arg1->unionDef(arg2);
-    arg1->insertPDGEdge(node);
+    arg1->insertPDGEdge(graph, _pdgEdges, node);
     arg1->removeConsts();
     arg1->clear(node);
     reachDef->push(arg1);
@@ -365,7 +421,7 @@ void PDG::visitConvertInst(ConvertInst* node) {
     assert(reachDef->stackSize() >= 1);
 
     // write dependencies of arg in top of the stack to this inst
-    reachDef->peek()->insertPDGEdge(node);
+    reachDef->peek()->insertPDGEdge(graph, _pdgEdges, node);
 
     // following inst using this value depend of the result in this inst
     reachDef->peek()->clear(node);
@@ -384,7 +440,7 @@ void PDG::visitUnaryInst(UnaryInst* node) {
 
     auto arg = reachDef->peek();
     // write dependecies
-    arg->insertPDGEdge(node);
+    arg->insertPDGEdge(graph, _pdgEdges, node);
     arg->removeConsts();
 
     // Set dependencies to this inst
@@ -403,7 +459,7 @@ void PDG::visitLoadInst(LoadInst* node) {
     assert(reachDef->stackSize() >= 1);
 
     // pop index and write dependencies
-    reachDef->pop()->insertPDGEdge(node);
+    reachDef->pop()->insertPDGEdge(graph, _pdgEdges, node);
 
     // push a value to the stack
     reachDef->push();
@@ -424,8 +480,8 @@ void PDG::visitStoreInst(StoreInst* node) {
     auto i = reachDef->pop();
 
     // write dependencies to this inst
-    c->insertPDGEdge(node);
-    i->insertPDGEdge(node);
+    c->insertPDGEdge(graph, _pdgEdges, node);
+    i->insertPDGEdge(graph, _pdgEdges, node);
     // ---------------------------------------
     advance(node, reachDef);
 }
@@ -450,7 +506,7 @@ void PDG::visitBrIfInst(BrIfInst* node) {
     assert(reachDef->stackSize() >= 1);
 
     auto arg = reachDef->pop();
-    arg->insertPDGEdge(node);
+    arg->insertPDGEdge(graph, _pdgEdges, node);
 
     // it expects the jumpp block (if true) to pop labels
     // ---------------------------------------
@@ -466,7 +522,7 @@ void PDG::visitGlobalGetInst(GlobalGetInst* node) {
 
     reachDef->push(reachDef->getGlobal(node->label()));
     auto varDef = reachDef->peek();
-    varDef->insertPDGEdge(node);
+    varDef->insertPDGEdge(graph, _pdgEdges, node);
     varDef->clear(node);
     if (varDef->isEmpty()) {
         // set is empty, thus the var depends on itself
@@ -485,7 +541,7 @@ void PDG::visitGlobalSetInst(GlobalSetInst* node) {
     assert(reachDef->stackSize() >= 1);
 
     auto arg = reachDef->pop();
-    arg->insertPDGEdge(node);
+    arg->insertPDGEdge(graph, _pdgEdges, node);
     arg->clear(node);
     reachDef->insertGlobal(node->label(), arg);
 
@@ -502,7 +558,7 @@ void PDG::visitLocalGetInst(LocalGetInst* node) {
 
     reachDef->push(reachDef->getLocal(node->label()));
     auto varDef = reachDef->peek();
-    varDef->insertPDGEdge(node);
+    varDef->insertPDGEdge(graph, _pdgEdges, node);
     varDef->clear(node);
     if (varDef->isEmpty()) {
         // set is empty, thus the var depends on itself
@@ -522,7 +578,7 @@ void PDG::visitLocalSetInst(LocalSetInst* node) {
     assert(reachDef->stackSize() >= 1);
 
     auto arg = reachDef->pop();
-    arg->insertPDGEdge(node);
+    arg->insertPDGEdge(graph, _pdgEdges, node);
     arg->clear(node);
 
     reachDef->insertLocal(node->label(), arg);
@@ -540,7 +596,7 @@ void PDG::visitLocalTeeInst(LocalTeeInst* node) {
 
     // pop value
     auto arg = reachDef->pop();
-    arg->insertPDGEdge(node);
+    arg->insertPDGEdge(graph, _pdgEdges, node);
 
     // perform a local.set of value
     reachDef->insertLocal(node->label(), arg);
@@ -565,7 +621,7 @@ void PDG::visitCallInst(CallInst* node) {
     // Pop args
     for (Index i = 0; i < node->nargs(); i++) {
         auto arg = reachDef->pop();
-        arg->insertPDGEdge(node);
+        arg->insertPDGEdge(graph, _pdgEdges, node);
     }
 
     // push returns
@@ -590,12 +646,12 @@ void PDG::visitCallIndirectInst(CallIndirectInst* node) {
 
     // pop func index
     auto index = reachDef->pop();
-    index->insertPDGEdge(node);
+    index->insertPDGEdge(graph, _pdgEdges, node);
 
     // Pop args
     for (Index i = 0; i < node->nargs() - 1; i++) {
         auto arg = reachDef->pop();
-        arg->insertPDGEdge(node);
+        arg->insertPDGEdge(graph, _pdgEdges, node);
     }
 
     // push returns
@@ -609,8 +665,8 @@ void PDG::visitCallIndirectInst(CallIndirectInst* node) {
     advance(node, reachDef);
 }
 void PDG::visitBeginBlockInst(BeginBlockInst* node) {
-    if (!_loopsStack.empty() && _loopsInsts.count(_loopsStack.top()) == 1) {
-        _loopsInsts[_loopsStack.top()].insert(node);
+    if (!_loopsStack.empty()) {
+        _loopsBlocks[_loopsStack.top()].insert(node);
     }
     if (waitPaths(node)) {
         return;
@@ -643,10 +699,6 @@ void PDG::visitBlockInst(BlockInst* node) {
     advance(node, reachDef);
 }
 void PDG::visitLoopInst(LoopInst* node) {
-    if (_loopsInsts.count(node) == 0) {
-        _loopsInsts[node] =
-            Query::BFSincludes({node}, Query::ALL_NODES, Query::AST_EDGES);
-    }
     int count = _loops.count(node);
     if (waitPaths(node, true)) {
         return;
@@ -657,7 +709,7 @@ void PDG::visitLoopInst(LoopInst* node) {
     auto reachDef = getReachDef(node);
     if (count == 1) {
         // if comes from outside loop, look cache to avoid repeat work.
-        if (_loopsInsts[node].count(_lastNode) == 0) {
+        if (!inLoop(node, _lastNode)) {
             if (contains(_loopsEntrances[node], reachDef)) {
                 reachDef =
                     std::make_shared<ReachDefinition>(*_cacheDefloops[node]);
@@ -672,7 +724,7 @@ void PDG::visitLoopInst(LoopInst* node) {
         reachDef->unionDef(_loops[node]);
         if (reachDef->equals(*_loops[node])) {
             _cacheDefloops[node] = std::make_shared<ReachDefinition>(*reachDef);
-            if (_loopsInsts[node].count(_lastNode) == 1 &&
+            if (inLoop(node, _lastNode) &&
                 (_loopsStack.empty() || _loopsStack.top() != node)) {
                 return;
             }
@@ -729,11 +781,23 @@ void PDG::visitIfInst(IfInst* node) {
     assert(reachDef->stackSize() >= 1);
 
     auto condition = reachDef->pop();
-    condition->insertPDGEdge(node);
+    condition->insertPDGEdge(graph, _pdgEdges, node);
     // ---------------------------------------
     advance(node, getReachDef(node));
 }
 
+inline bool PDG::inLoop(Node* loop, Node* node) {
+    if (node == nullptr) {
+        return false;
+    }
+    const ASTIntervals* intervals = graph.getASTIntervals();
+    if (intervals->contains(node) && intervals->isWithin(node, loop)) {
+        return true;
+    }
+    auto it = _loopsBlocks.find(loop);
+    return it != _loopsBlocks.end() && it->second.count(node) == 1;
+}
+
 inline bool PDG::waitPaths(Instruction* inst, bool isLoop) {
     Index inEdgesNum = inst->inEdges(EdgeType::CFG).size();
     if (isLoop) {
@@ -742,22 +806,17 @@ inline bool PDG::waitPaths(Instruction* inst, bool isLoop) {
         // all external.
         // 2) It comes from inside the loop - in this case we need to wait for
         // all internal
-        auto inEdges = inst->inEdges(EdgeType::CFG);
-        EdgeSet filterQuery;
-        // Case 1
-        if (_loopsInsts[inst].count(_lastNode) == 0) {
-            filterQuery = Query::filterEdges(inEdges, [&](Edge* e) {
-                return _loopsInsts[inst].count(e->src()) == 0;
-            });
-        } else {  // Case 2
-            filterQuery = Query::filterEdges(inEdges, [&](Edge* e) {
-                return _loopsInsts[inst].count(e->src()) == 1;
-            });
+        // Case 1: count external edges, Case 2: count internal edges
+        bool internal = inLoop(inst, _lastNode);
+        inEdgesNum = 0;
+        for (Edge* e : inst->inEdges(EdgeType::CFG)) {
+            if (inLoop(inst, e->src()) == internal) {
+                inEdgesNum++;
+            }
         }
-        inEdgesNum = filterQuery.size();
     }
     if (!_loopsStack.empty()) {
-        return _loopsInsts[_loopsStack.top()].count(inst) != 1 ||
+        return !inLoop(_loopsStack.top(), inst) ||
                _reachDef[inst].size() < inEdgesNum;
     }
     return _reachDef[inst].size() < inEdgesNum;
@@ -820,6 +879,18 @@ inline std::shared_ptr<ReachDefinition> PDG::getReachDef(Instruction* inst) {
 inline void PDG::advance(Instruction* inst,
                          std::shared_ptr<ReachDefinition> resultReachDef) {
     // WARNING: resultReachDef might change when advancing
+    const BasicBlocks* blocks = graph.getBasicBlocks();
+    if (blocks != nullptr && blocks->blockOf(inst) != BasicBlocks::NONE) {
+        NodeRange rest = blocks->rest(inst, false);
+        if (!rest.empty()) {
+            // The next node of the block is the only successor of inst, and
+            // inst is its only predecessor.
+            _next = *rest.begin();
+            _reachDef[_next].insert(resultReachDef);
+            _reachDef.erase(inst);
+            return;
+        }
+    }
     auto outEdges = inst->outEdges(EdgeType::CFG);
 
     if (outEdges.size() >= 1) {
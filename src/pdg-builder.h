@@ -6,18 +6,47 @@
 #include <set>
 #include <sstream>
 #include <stack>
+#include <unordered_set>
 #include "graph.h"
 #include "query.h"
 #include "src/cast.h"
+#include "src/memory-usage.h"
 
 using namespace wabt;
 
 namespace wasmati {
 class ReachDefinition;
 
+/// Identity of a PDG edge: two PDG edges with the same key are duplicates.
+struct PDGEdgeKey {
+    Index src;
+    Index dest;
+    Symbol label;
+    PDGType type;
+
+    PDGEdgeKey(Index src, Index dest, Symbol label, PDGType type)
+        : src(src), dest(dest), label(label), type(type) {}
+
+    inline bool operator==(const PDGEdgeKey& other) const {
+        return src == other.src && dest == other.dest &&
+               label == other.label && type == other.type;
+    }
+
+    struct Hash {
+        inline size_t operator()(const PDGEdgeKey& key) const {
+            uint64_t ends = (static_cast<uint64_t>(key.src) << 32) | key.dest;
+            uint64_t rest = (static_cast<uint64_t>(key.label.id()) << 8) |
+                            static_cast<uint64_t>(key.type);
+            return std::hash<uint64_t>()(ends ^ (rest * 0x9e3779b97f4a7c15ull));
+        }
+    };
+};
+typedef std::unordered_set<PDGEdgeKey, PDGEdgeKey::Hash> PDGEdgeSet;
+
 class PDG {
 private:
     ModuleContext& mc;
+    Graph& graph;
 
     std::list<std::tuple<Node*, std::shared_ptr<std::stack<LoopInst*>>, Node*>>
         _dfsList;
@@ -28,22 +57,46 @@ private:
     std::map<Node*, std::list<std::shared_ptr<ReachDefinition>>>
         _loopsEntrances;
     std::map<Node*, std::shared_ptr<ReachDefinition>> _cacheDefloops;
-    std::map<Node*, NodeSet> _loopsInsts;
+    // Begin blocks reached inside each loop, they are not part of the AST.
+    std::map<Node*, NodeSet> _loopsBlocks;
     std::stack<LoopInst*> _loopsStack;
+    // PDG edges of the function being built. They only join instructions of
+    // one function, so the set is emptied before the next one.
+    PDGEdgeSet _pdgEdges;
     Node* _lastNode;
+    // Next node of the basic block of the one being visited, which is
+    // visited right after it instead of through _dfsList.
+    Node* _next = nullptr;
 
     json _verbose;
     NodeSet _verboseLoops;
 
+    size_t _peakMemory = 0;
+
 public:
-    PDG(ModuleContext& mc, Graph& graph) : mc(mc), _verbose(json::array()) {}
+    PDG(ModuleContext& mc, Graph& graph)
+        : mc(mc), graph(graph), _verbose(json::array()) {}
 
     ~PDG() {}
 
     void generatePDG();
+    /// Builds the PDG of one function.
+    void generateFunction(Node* func);
+    /// Leaves the PDG of every function of graph to be built the first time
+    /// a query reads the edges of one of its instructions. The edges are the
+    /// same as with generatePDG. Returns the builder the graph keeps for it.
+    static std::shared_ptr<PDG> defer(ModuleContext& mc, Graph& graph);
+
+    /// Bytes held by the reaching definitions and the other per function
+    /// state right now.
+    size_t getMemoryUsage() const;
+    /// Largest getMemoryUsage seen at the end of a function, sampled only
+    /// when the info output is enabled.
+    inline size_t getPeakMemoryUsage() const { return _peakMemory; }
 
 private:
     void visitCFGEdge(Edge* e, std::shared_ptr<std::stack<LoopInst*>> stack);
+    void visit(Node* inst);
     void visitInstructions(Instructions* e);
     void visitNopInst(NopInst* node);
     void visitUnreachableInst(UnreachableInst* node);
@@ -76,6 +129,7 @@ private:
     void visitIfInst(IfInst* node);
 
     // Auxiliars
+    inline bool inLoop(Node* loop, Node* node);
     inline bool waitPaths(Instruction* inst, bool isLoop = false);
     inline std::shared_ptr<ReachDefinition> getReachDef(Instruction* inst);
     inline void advance(Instruction* inst,
@@ -112,15 +166,21 @@ class Definition {
 public:
     struct Var {
         const std::string name;
+        const Symbol symbol;
         const Const* value;
         const PDGType type;
         Node* src;
 
         Var(const std::string& name, const PDGType type, Node* node)
-            : name(name), value(nullptr), type(type), src(node) {}
+            : name(name),
+              symbol(node->intern(name)),
+              value(nullptr),
+              type(type),
+              src(node) {}
 
         Var(const Const* value, Node* node)
             : name(Utils::writeConst(*value)),
+              symbol(node->intern(name)),
               value(value),
               type(PDGType::Const),
               src(node) {}
@@ -129,9 +189,18 @@ public:
             const Const* value,
             const PDGType type,
             Node* node)
-            : name(name), value(value), type(type), src(node) {}
+            : name(name),
+              symbol(node->intern(name)),
+              value(value),
+              type(type),
+              src(node) {}
 
-        Var(const Var& var) : Var(var.name, var.value, var.type, var.src) {}
+        Var(const Var& var)
+            : name(var.name),
+              symbol(var.symbol),
+              value(var.value),
+              type(var.type),
+              src(var.src) {}
 
         bool operator==(const Var& o) const {
             return name.compare(o.name) == 0 && value == o.value &&
@@ -172,22 +241,21 @@ public:
 
     inline bool isEmpty() const { return _def.size() == 0; }
 
-    inline void insertPDGEdge(Node* target) {
+    /// Adds an edge from every definition to target, unless edges, the
+    /// PDG edges built so far, has it already.
+    inline void insertPDGEdge(Graph& graph, PDGEdgeSet& edges, Node* target) {
         for (auto const& kv : _def) {
-            auto inEdges = target->inEdges(EdgeType::PDG);
-            auto filter = Query::filterEdges(inEdges, [&](Edge* e) {
-                return e->src() == kv.second.src && e->dest() == target &&
-                       e->pdgType() == kv.second.type &&
-                       e->label() == kv.second.name;
-            });
-            if (filter.size() > 0) {
+            PDGEdgeKey key(kv.second.src->id(), target->id(),
+                           kv.second.symbol, kv.second.type);
+            if (!edges.insert(key).second) {
                 continue;
             }
             if (kv.second.type == PDGType::Const) {
-                new PDGEdgeConst(kv.second.src, target, *kv.second.value);
+                graph.newEdge<PDGEdgeConst>(kv.second.src, target,
+                                            *kv.second.value);
             } else {
-                new PDGEdge(kv.second.src, target, kv.second.name,
-                            kv.second.type);
+                graph.newEdge<PDGEdge>(kv.second.src, target,
+                                       kv.second.symbol, kv.second.type);
             }
         }
     }
@@ -223,6 +291,14 @@ public:
         return true;
     }
 
+    inline size_t heapBytes() const {
+        size_t result = memory::heapBytes(_def);
+        for (auto const& kv : _def) {
+            result += memory::heapBytes(kv.second.name);
+        }
+        return result;
+    }
+
     friend void to_json(json& j, const Definition& d) {
         for (auto const& kv : d._def) {
             json def;
@@ -291,6 +367,19 @@ public:
         return true;
     }
 
+    /// Heap bytes of the definitions, the ones already in seen are shared
+    /// with an object counted before and are skipped.
+    inline size_t heapBytes(std::set<const void*>& seen) const {
+        size_t result = memory::heapBytes(_defs);
+        for (auto const& kv : _defs) {
+            result += memory::heapBytes(kv.first);
+            if (seen.insert(kv.second.get()).second) {
+                result += sizeof(Definition) + kv.second->heapBytes();
+            }
+        }
+        return result;
+    }
+
     friend void to_json(json& j, const Definitions& d) {
         for (auto const& kv : d._defs) {
             j[kv.first] = *kv.second;
@@ -455,6 +544,20 @@ public:
         return true;
     }
 
+    inline size_t heapBytes(std::set<const void*>& seen) const {
+        size_t result = _globals.heapBytes(seen) + _locals.heapBytes(seen);
+        result += memory::heapBytes(_stack) + memory::heapBytes(_labels);
+        for (auto const& def : _stack) {
+            if (seen.insert(def.get()).second) {
+                result += sizeof(Definition) + def->heapBytes();
+            }
+        }
+        for (auto const& label : _labels) {
+            result += memory::heapBytes(label.name);
+        }
+        return result;
+    }
+
     friend void to_json(json& j, const ReachDefinition& v) {
         j["globals"] = v._globals;
         j["locals"] = v._locals;
@@ -0,0 +1,108 @@
+#ifndef WASMATI_POINTER_MAP_H
+#define WASMATI_POINTER_MAP_H
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace wasmati {
+
+/// Map from pointers to values kept in one flat array, with open addressing
+/// and linear probing. A lookup hashes the pointer and reads a few adjacent
+/// slots instead of walking a tree. Entries are never removed.
+template <class K, class V>
+class PointerMap {
+    struct Slot {
+        const K* key;
+        V value;
+    };
+
+    std::vector<Slot> _slots;
+    size_t _size;
+
+    static inline size_t hash(const K* key) {
+        // Mixes the high bits in, the low ones are zero from alignment.
+        uint64_t h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(key));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return static_cast<size_t>(h);
+    }
+
+    inline size_t find(const K* key) const {
+        assert(key != nullptr);
+        size_t mask = _slots.size() - 1;
+        size_t i = hash(key) & mask;
+        while (_slots[i].key != nullptr && _slots[i].key != key) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void grow(size_t capacity) {
+        std::vector<Slot> old(capacity, Slot{nullptr, V()});
+        old.swap(_slots);
+        for (const Slot& slot : old) {
+            if (slot.key != nullptr) {
+                _slots[find(slot.key)] = slot;
+            }
+        }
+    }
+
+public:
+    PointerMap() : _slots(16, Slot{nullptr, V()}), _size(0) {}
+
+    /// Makes room for n entries without growing again.
+    void reserve(size_t n) {
+        size_t capacity = _slots.size();
+        while (capacity < 2 * n) {
+            capacity *= 2;
+        }
+        if (capacity != _slots.size()) {
+            grow(capacity);
+        }
+    }
+
+    /// Value of key, inserted as V() if it was not there.
+    V& operator[](const K* key) {
+        // Keeps the table at most half full.
+        if (2 * (_size + 1) > _slots.size()) {
+            grow(2 * _slots.size());
+        }
+        size_t i = find(key);
+        if (_slots[i].key == nullptr) {
+            _slots[i].key = key;
+            _size++;
+        }
+        return _slots[i].value;
+    }
+
+    /// Throws std::out_of_range if key has no entry, like
+    /// std::unordered_map::at.
+    inline const V& at(const K* key) const {
+        size_t i = find(key);
+        if (_slots[i].key != key) {
+            throw std::out_of_range("PointerMap::at");
+        }
+        return _slots[i].value;
+    }
+
+    inline size_t count(const K* key) const {
+        return _slots[find(key)].key == key ? 1 : 0;
+    }
+
+    /// Removes every entry, the slots are kept for the next ones.
+    void clear() {
+        std::fill(_slots.begin(), _slots.end(), Slot{nullptr, V()});
+        _size = 0;
+    }
+
+    inline size_t size() const { return _size; }
+    inline size_t heapBytes() const { return _slots.capacity() * sizeof(Slot); }
+};
+
+}  // namespace wasmati
+
+#endif /* WASMATI_POINTER_MAP_H */
@@ -14,11 +14,10 @@ void VulnerabilityChecker::BoScanfLoops() {
             continue;
         }
         // find all loops
-        auto loops =
-            Query::instructions({func}, Predicate().instType(InstType::Loop));
+        auto loops = Query::loops({func});
 
         for (Node* loop : loops) {
-            auto insts = Query::BFS({loop}, Query::ALL_INSTS, Query::AST_EDGES);
+            auto insts = Query::filter(Query::loopBody(loop), Query::ALL_INSTS);
             auto callScanf = Query::filter(
                 insts,
                 Predicate()
@@ -1,8 +1,60 @@
 #include "query.h"
 #include <iostream>
 namespace wasmati {
-const Graph* Query::_graph = nullptr;
-NodeSet Query::emptyNodeSet = NodeSet();
+thread_local const QueryContext* QueryContext::_current = nullptr;
+thread_local NodeSet Query::emptyNodeSet = NodeSet();
+
+void QueryContext::checkCFG() const {
+    size_t cfgEdges = _graph.getStats().edges(EdgeType::CFG);
+    if (cfgEdges != _cfgEdges) {
+        _dominators[0].clear();
+        _dominators[1].clear();
+        _loops.clear();
+        _cfgEdges = cfgEdges;
+    }
+}
+
+const DominatorTree& QueryContext::dominatorTree(Node* function,
+                                                 bool post) const {
+    checkCFG();
+    auto& tree = _dominators[post ? 1 : 0][function];
+    if (!tree) {
+        tree.reset(new DominatorTree(function, post));
+    }
+    return *tree;
+}
+
+const LoopForest& QueryContext::loopForest(Node* function) const {
+    checkCFG();
+    auto& forest = _loops[function];
+    if (!forest) {
+        forest.reset(new LoopForest(function));
+    }
+    return *forest;
+}
+
+Edge* QueryContext::hubEdge(Node* call, Node* callee) const {
+    auto& edge = _hubEdges[std::make_pair(call, callee)];
+    if (!edge) {
+        edge.reset(new CGEdge(call, callee));
+    }
+    return edge.get();
+}
+
+size_t QueryContext::getMemoryUsage() const {
+    size_t result = sizeof(*this);
+    result += _hubEdges.size() * sizeof(CGEdge) +
+              memory::heapBytes(_hubEdges);
+    for (auto& trees : _dominators) {
+        for (auto& tree : trees) {
+            result += tree.second->getMemoryUsage();
+        }
+    }
+    for (auto& forest : _loops) {
+        result += forest.second->getMemoryUsage();
+    }
+    return result;
+}
 const EdgeCondition& Query::ALL_EDGES = [](Edge*) { return true; };
 const EdgeCondition& Query::AST_EDGES = [](Edge* e) {
     return e->type() == EdgeType::AST;
@@ -25,20 +77,51 @@ const NodeCondition& Query::ALL_NODES = [](Node* node) { return true; };
 const Predicate& Query::TRUE_PREDICATE = Predicate().truePredicate();
 
 EdgeCondition Query::pdgEdge(std::string label, PDGType pdgType) {
-    return [=](Edge* e) {
-        return e->type() == EdgeType::PDG && e->label() == label &&
-               e->pdgType() == pdgType;
+    SymbolMatcher matcher(label);
+    return [=](Edge* e) mutable {
+        return e->type() == EdgeType::PDG && e->pdgType() == pdgType &&
+               matcher.matches(e->src()->graph()->strings(), e->labelSymbol());
     };
 }
 
+EdgeType Query::edgeType(const EdgeCondition& edgeCondition) {
+    if (&edgeCondition == &AST_EDGES) {
+        return EdgeType::AST;
+    } else if (&edgeCondition == &CFG_EDGES) {
+        return EdgeType::CFG;
+    } else if (&edgeCondition == &PDG_EDGES) {
+        return EdgeType::PDG;
+    } else if (&edgeCondition == &CG_EDGES) {
+        return EdgeType::CG;
+    }
+    return EdgeType::None;
+}
+
+EdgeSet Query::edges(Node* node, bool reverse) {
+    assert(QueryContext::current() != nullptr);
+    const QueryContext* context = QueryContext::current();
+    EdgeSet result;
+    auto keep = [&](Edge* view, Node*) {
+        result.insert(context->hubEdge(view->src(), view->dest()));
+    };
+    for (Edge* e : reverse ? node->inEdges() : node->outEdges()) {
+        Node* neighbour = reverse ? e->src() : e->dest();
+        if (e->type() == EdgeType::CG &&
+            neighbour->type() == NodeType::SignatureHub) {
+            forEachThroughHub(e, neighbour, ALL_EDGES, reverse, keep);
+        } else {
+            result.insert(e);
+        }
+    }
+    return result;
+}
+
 NodeSet Query::children(const NodeSet& nodes,
                         const EdgeCondition& edgeCondition) {
     NodeSet result;
     for (Node* node : nodes) {
-        EdgeSet edges = filterEdges(node->outEdges(), edgeCondition);
-        for (Edge* e : edges) {
-            result.insert(e->dest());
-        }
+        forEachNeighbour(node, edgeCondition, false,
+                         [&](Edge*, Node* dest) { result.insert(dest); });
     }
     return result;
 }
@@ -55,10 +138,8 @@ NodeSet Query::parents(const NodeSet& nodes,
                        const EdgeCondition& edgeCondition) {
     NodeSet result;
     for (Node* node : nodes) {
-        EdgeSet edges = filterEdges(node->inEdges(), edgeCondition);
-        for (Edge* e : edges) {
-            result.insert(e->src());
-        }
+        forEachNeighbour(node, edgeCondition, true,
+                         [&](Edge*, Node* src) { result.insert(src); });
     }
     return result;
 }
@@ -74,14 +155,52 @@ EdgeSet Query::filterEdges(const EdgeSet& edges,
     return result;
 }
 
+/// Calls func with every node whose condition evaluates to expected, until
+/// func returns false.
+template <class F>
+static void scanNodes(const NodeSet& nodes,
+                      const NodeCondition& condition,
+                      bool expected,
+                      F func) {
+    for (Node* node : nodes) {
+        if (condition(node) == expected && !func(node)) {
+            return;
+        }
+    }
+}
+
+/// Same as above for predicates. When the graph has property columns the
+/// predicate is evaluated by node id, so column tests do not touch the nodes.
+template <class F>
+static void scanNodes(const NodeSet& nodes,
+                      const Predicate& predicate,
+                      bool expected,
+                      F func) {
+    const Graph* graph = nodes.empty() ? nullptr : nodes.front()->graph();
+    const PropertyColumns* columns =
+        graph != nullptr ? graph->getColumns() : nullptr;
+    if (columns == nullptr) {
+        for (Node* node : nodes) {
+            if (predicate.evaluate(node) == expected && !func(node)) {
+                return;
+            }
+        }
+        return;
+    }
+    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+        if (predicate.evaluate(*columns, it.id()) == expected && !func(*it)) {
+            return;
+        }
+    }
+}
+
 #define WASMATI_EVALUATION(type, var, eval, rALL)                  \
     NodeSet Query::filter(const NodeSet& nodes, const type& var) { \
         NodeSet result;                                            \
-        for (Node * node : nodes) {                                \
-            if (eval(node)) {                                      \
-                result.insert(node);                               \
-            }                                                      \
-        }                                                          \
+        scanNodes(nodes, var, true, [&](Node* node) {              \
+            result.insert(node);                                   \
+            return true;                                           \
+        });                                                        \
         return result;                                             \
     }
 #include "src/config/predicates.def"
@@ -90,11 +209,10 @@ EdgeSet Query::filterEdges(const EdgeSet& edges,
 #define WASMATI_EVALUATION(type, var, eval, rALL)                     \
     NodeSet Query::filterOut(const NodeSet& nodes, const type& var) { \
         NodeSet result;                                               \
-        for (Node * node : nodes) {                                   \
-            if (!eval(node)) {                                        \
-                result.insert(node);                                  \
-            }                                                         \
-        }                                                             \
+        scanNodes(nodes, var, false, [&](Node* node) {                \
+            result.insert(node);                                      \
+            return true;                                              \
+        });                                                           \
         return result;                                                \
     }
 #include "src/config/predicates.def"
@@ -102,12 +220,12 @@ EdgeSet Query::filterEdges(const EdgeSet& edges,
 
 #define WASMATI_EVALUATION(type, var, eval, rALL)                 \
     bool Query::contains(const NodeSet& nodes, const type& var) { \
-        for (Node * node : nodes) {                               \
-            if (eval(node)) {                                     \
-                return true;                                      \
-            }                                                     \
-        }                                                         \
-        return false;                                             \
+        bool found = false;                                       \
+        scanNodes(nodes, var, true, [&](Node*) {                  \
+            found = true;                                         \
+            return false;                                         \
+        });                                                       \
+        return found;                                             \
     }
 #include "src/config/predicates.def"
 #undef WASMATI_EVALUATION
@@ -136,11 +254,56 @@ NodeSet Query::map(const NodeSet& nodes,
     NodeSet result;
     for (Node* node : nodes) {
         auto mapping = func(node);
-        result.insert(mapping.begin(), mapping.end());
+        result.unite(mapping);
+    }
+    return result;
+}
+
+// Nodes reached from nodes through one or more CFG edges, walked a basic
+// block at a time.
+static NodeSet reachCFG(const NodeSet& nodes,
+                        const BasicBlocks& blocks,
+                        bool reverse) {
+    NodeSet result;
+    std::unordered_set<Index> seen;
+    std::vector<Index> queue;
+    auto follow = [&](Index block) {
+        blocks.forEachNeighbour(block, reverse, [&](Index next) {
+            if (seen.insert(next).second) {
+                queue.push_back(next);
+            }
+        });
+    };
+    for (Node* node : nodes) {
+        if (blocks.blockOf(node) == BasicBlocks::NONE) {
+            continue;
+        }
+        for (Node* rest : blocks.rest(node, reverse)) {
+            result.insert(rest);
+        }
+        follow(blocks.blockOf(node));
+    }
+    while (!queue.empty()) {
+        Index block = queue.back();
+        queue.pop_back();
+        for (Node* node : blocks.nodes(block)) {
+            result.insert(node);
+        }
+        follow(block);
     }
     return result;
 }
 
+// Basic blocks of the graph being queried, null if there are none or nodes
+// belong to another graph.
+static const BasicBlocks* basicBlocks(const NodeSet& nodes) {
+    const QueryContext* context = QueryContext::current();
+    if (context == nullptr || nodes.front()->graph() != &context->graph()) {
+        return nullptr;
+    }
+    return context->graph().getBasicBlocks();
+}
+
 #define WASMATI_EVALUATION(type, var, eval, rALL)                         \
     NodeSet Query::BFS(const NodeSet& nodes, const type& var,             \
                        const EdgeCondition& edgeCondition, Index limit,   \
@@ -150,11 +313,17 @@ NodeSet Query::map(const NodeSet& nodes,
         if (nodes.size() == 0 || limit == 0) {                            \
             return result;                                                \
         }                                                                 \
+        const BasicBlocks* blocks = basicBlocks(nodes);                   \
+        if (blocks != nullptr && limit == UINT32_MAX &&                   \
+            &edgeCondition == &CFG_EDGES) {                               \
+            return filter(reachCFG(nodes, *blocks, reverse), var);        \
+        }                                                                 \
         auto mapFunction = [&](Node* node) {                              \
-            auto edges = reverse ? node->inEdges() : node->outEdges();    \
-            return map<Node*>(                                            \
-                filterEdges(edges, edgeCondition),                        \
-                [&](Edge* e) { return reverse ? e->src() : e->dest(); }); \
+            std::list<Node*> neighbours;                                  \
+            forEachNeighbour(                                             \
+                node, edgeCondition, reverse,                             \
+                [&](Edge*, Node* n) { neighbours.push_back(n); });        \
+            return neighbours;                                            \
         };                                                                \
                                                                           \
         std::list<Node*> queue = map<Node*>(nodes, mapFunction);          \
@@ -192,15 +361,14 @@ NodeSet Query::map(const NodeSet& nodes,
         }                                                                      \
         auto result =                                                          \
             BFS(nodes, var, edgeCondition, limit - filtering.size(), reverse); \
-        result.insert(filtering.begin(), filtering.end());                     \
+        result.unite(filtering);                                               \
         return result;                                                         \
     }
 #include "src/config/predicates.def"
 #undef WASMATI_EVALUATION
 
 NodeSet Query::module() {
-    assert(_graph != nullptr);
-    return {_graph->getModule()};
+    return {graph().getModule()};
 }
 
 NodeSet Query::functions(const NodeCondition& nodeCondition) {
@@ -213,6 +381,10 @@ NodeSet Query::functions(const Predicate& predicate) {
 
 Node* Query::function(Node* node) {
     assert(node->type() != NodeType::Module);
+    const ASTIntervals* intervals = node->graph()->getASTIntervals();
+    if (intervals != nullptr && intervals->contains(node)) {
+        return intervals->function(node);
+    }
     return NodeStream(node)
         .BFSincludes(
             [](Node* node) { return node->type() == NodeType::Function; },
@@ -221,14 +393,130 @@ Node* Query::function(Node* node) {
         .get();
 }
 
-#define WASMATI_EVALUATION(TYPE, var, eval, rALL)                           \
-    NodeSet Query::instructions(const NodeSet& nodes, const TYPE& var) {    \
-        return BFS(                                                         \
-            nodes,                                                          \
-            [&](Node* node) {                                               \
-                return node->type() == NodeType::Instruction && eval(node); \
-            },                                                              \
-            AST_EDGES);                                                     \
+// Function of a node of the CFG. The nodes made by the CFG are not in the
+// AST, they belong to the function of the node before them.
+static Node* cfgFunction(Node* node) {
+    while (node->inEdges(EdgeType::AST).empty()) {
+        if (node->type() != NodeType::Instruction) {
+            // The module or the trap.
+            return nullptr;
+        }
+        auto edges = node->inEdges(EdgeType::CFG);
+        if (edges.empty()) {
+            return nullptr;
+        }
+        node = edges[0]->src();
+    }
+    return Query::function(node);
+}
+
+static bool dominates(Node* a, Node* b, bool post) {
+    Node* function = cfgFunction(b);
+    if (function == nullptr || cfgFunction(a) != function) {
+        return false;
+    }
+    assert(QueryContext::current() != nullptr);
+    auto& tree = QueryContext::current()->dominatorTree(function, post);
+    return tree.contains(a) && tree.contains(b) && tree.dominates(a, b);
+}
+
+bool Query::dominates(Node* a, Node* b) {
+    return wasmati::dominates(a, b, false);
+}
+
+bool Query::postDominates(Node* a, Node* b) {
+    return wasmati::dominates(a, b, true);
+}
+
+// Loops of the function of node and the one headed by node, NONE if node
+// heads none.
+static const LoopForest* loopForest(Node* node, Index* headed = nullptr) {
+    Node* function = cfgFunction(node);
+    if (function == nullptr) {
+        return nullptr;
+    }
+    assert(QueryContext::current() != nullptr);
+    auto& forest = QueryContext::current()->loopForest(function);
+    if (headed != nullptr) {
+        Index loop = forest.loopOf(node);
+        bool heads =
+            loop != LoopForest::NONE && forest.loops()[loop].header == node;
+        *headed = heads ? loop : LoopForest::NONE;
+    }
+    return &forest;
+}
+
+NodeSet Query::loops(const NodeSet& functions) {
+    NodeSet result;
+    assert(QueryContext::current() != nullptr);
+    for (Node* function : functions) {
+        auto& forest = QueryContext::current()->loopForest(function);
+        for (auto& loop : forest.loops()) {
+            result.insert(loop.header);
+        }
+    }
+    return result;
+}
+
+Node* Query::loopHeader(Node* node) {
+    const LoopForest* forest = loopForest(node);
+    if (forest == nullptr || forest->loopOf(node) == LoopForest::NONE) {
+        return nullptr;
+    }
+    return forest->loops()[forest->loopOf(node)].header;
+}
+
+Index Query::loopDepth(Node* node) {
+    const LoopForest* forest = loopForest(node);
+    return forest == nullptr ? 0 : forest->depth(node);
+}
+
+NodeSet Query::loopBody(Node* header) {
+    Index loop;
+    const LoopForest* forest = loopForest(header, &loop);
+    if (forest == nullptr || loop == LoopForest::NONE) {
+        return NodeSet();
+    }
+    NodeRange body = forest->body(loop);
+    return NodeSet(body.begin(), body.end());
+}
+
+EdgeSet Query::loopExits(Node* header) {
+    Index loop;
+    const LoopForest* forest = loopForest(header, &loop);
+    if (forest == nullptr || loop == LoopForest::NONE) {
+        return EdgeSet();
+    }
+    auto& exits = forest->loops()[loop].exits;
+    return EdgeSet(exits.begin(), exits.end());
+}
+
+#define WASMATI_EVALUATION(TYPE, var, eval, rALL)                        \
+    NodeSet Query::instructions(const NodeSet& nodes, const TYPE& var) { \
+        auto test = [&](Node* node) {                                    \
+            return node->type() == NodeType::Instruction && eval(node);  \
+        };                                                               \
+        if (nodes.empty()) {                                             \
+            return NodeSet();                                            \
+        }                                                                \
+        const ASTIntervals* intervals =                                  \
+            nodes.front()->graph()->getASTIntervals();                   \
+        if (intervals == nullptr) {                                      \
+            return BFS(nodes, test, AST_EDGES);                          \
+        }                                                                \
+        NodeSet result;                                                  \
+        for (Node * node : nodes) {                                      \
+            if (!intervals->contains(node)) {                            \
+                result.unite(BFS({node}, test, AST_EDGES));              \
+                continue;                                                \
+            }                                                            \
+            for (Node * inst : intervals->descendants(node)) {           \
+                if (test(inst)) {                                        \
+                    result.insert(inst);                                 \
+                }                                                        \
+            }                                                            \
+        }                                                                \
+        return result;                                                   \
     }
 #include "src/config/predicates.def"
 #undef WASMATI_EVALUATION
@@ -246,7 +534,7 @@ Node* Query::function(Node* node) {
             assert(paramsNode.size() <= 1);                              \
             if (paramsNode.size() == 1) {                                \
                 auto childs = children(paramsNode, AST_EDGES);           \
-                params.insert(childs.begin(), childs.end());             \
+                params.unite(childs);                                    \
             }                                                            \
         }                                                                \
         return filter(params, var);                                      \
@@ -261,30 +549,34 @@ NodeSet Query::parameters(const NodeSet& nodes) {
 
 NodeSet Queries::loopsInsts(std::string& loopName) {
     NodeSet results;
-    auto loops = NodeStream(Query::functions())
-                     .instructions([&](Node* node) {
-                         return node->instType() == InstType::Loop &&
-                                node->label() == loopName;
-                     })
-                     .toNodeSet();
-    results = Query::BFSincludes(loops, Query::ALL_INSTS, Query::AST_EDGES);
-    auto beginBlocks = Query::BFS(
-        loops,
-        [&](Node* node) {
-            return node->instType() == InstType::Block &&
-                   Query::contains(
-                       Query::parents({node}, Query::CFG_EDGES),
-                       [&](Node* n) { return results.count(n) == 1; });
-        },
-        Query::CFG_EDGES);
-
-    results.insert(beginBlocks.begin(), beginBlocks.end());
+    for (Node* loop : Query::loops(Query::functions())) {
+        if (loop->label() == loopName) {
+            results.unite(Query::loopBody(loop));
+        }
+    }
     return results;
 }
 Predicate& Predicate::insert(std::function<bool(Node* node)> f) {
     insertPredicate(std::make_shared<TestHolder>(f));
     return *this;
 }
+#define WASMATI_PREDICATE_COLUMN(funcName, TypeVal)                  \
+    Predicate& Predicate::funcName(TypeVal val, bool eq) {           \
+        insertPredicate(std::make_shared<ColumnTest<TypeVal>>(      \
+            &Node::funcName, &PropertyColumns::funcName, val, eq)); \
+        return *this;                                                \
+    }
+
+#define WASMATI_PREDICATE_SYMBOL(funcName)                                     \
+    Predicate& Predicate::funcName(std::string val, bool eq) {                 \
+        insertPredicate(std::make_shared<SymbolTest>(                          \
+            &Node::funcName##Symbol, &PropertyColumns::funcName, val, eq));    \
+        return *this;                                                          \
+    }
+#include "src/config/predicates.def"
+#undef WASMATI_PREDICATE_COLUMN
+#undef WASMATI_PREDICATE_SYMBOL
+
 Predicate& Predicate::truePredicate() {
     insertPredicate(std::make_shared<TruePredicate>());
     return *this;
@@ -2,9 +2,11 @@
 #define WASMATI_QUERY_BUILDER_H_
 
 #include <list>
+#include <memory>
 #include <set>
 #include <stack>
 #include "graph.h"
+#include "dominators.h"
 #include "include/nlohmann/json.hpp"
 #include "utils.h"
 
@@ -15,9 +17,99 @@ typedef std::function<bool(Node*)> NodeCondition;
 typedef std::function<bool(Edge*)> EdgeCondition;
 class Predicate;
 
+/// The graph queried by the current thread. Creating a context makes its
+/// graph the one every Query function of this thread works on until the
+/// context is destroyed, when the previous one is restored. A snapshot can be
+/// shared by contexts of different threads, see GraphSnapshot. A graph that
+/// is still being built may only be queried from the thread building it.
+class QueryContext {
+    static thread_local const QueryContext* _current;
+
+    const Graph& _graph;
+    const QueryContext* const _previous;
+    // Dominator trees by function, then post-dominator trees, the loops of
+    // the functions, and the CFG edge count of the graph they came from.
+    mutable std::unordered_map<const Node*, std::unique_ptr<DominatorTree>>
+        _dominators[2];
+    mutable std::unordered_map<const Node*, std::unique_ptr<LoopForest>>
+        _loops;
+    mutable size_t _cfgEdges;
+    // CG edges from a call_indirect to each callee of its SignatureHub.
+    mutable std::map<std::pair<const Node*, const Node*>,
+                     std::unique_ptr<CGEdge>>
+        _hubEdges;
+
+    /// Drops the CFG analyses if the graph has gained CFG edges.
+    void checkCFG() const;
+
+public:
+    explicit QueryContext(const GraphSnapshot& snapshot)
+        : QueryContext(snapshot.graph()) {}
+    explicit QueryContext(const Graph& graph)
+        : _graph(graph), _previous(_current), _cfgEdges(0) {
+        _current = this;
+    }
+    QueryContext(const QueryContext&) = delete;
+    QueryContext& operator=(const QueryContext&) = delete;
+    ~QueryContext() {
+        assert(_current == this);
+        _current = _previous;
+    }
+
+    inline const Graph& graph() const { return _graph; }
+
+    /// Dominator tree, or post-dominator tree, of the CFG of function. A
+    /// tree is built the first time it is asked for and kept by the context,
+    /// until the graph gains CFG edges.
+    const DominatorTree& dominatorTree(Node* function, bool post) const;
+    /// Loops of function, kept like the dominator trees.
+    const LoopForest& loopForest(Node* function) const;
+    /// CG edge from call to callee standing for the two edges through the
+    /// SignatureHub between them. It is made the first time it is asked for
+    /// and kept by the context, so it can be handed out, unlike the views of
+    /// Query::forEachThroughHub. No node lists it.
+    Edge* hubEdge(Node* call, Node* callee) const;
+    /// Bytes held by the analyses kept so far.
+    size_t getMemoryUsage() const;
+
+    /// Context of the calling thread, null if it has none.
+    static inline const QueryContext* current() { return _current; }
+};
+
 class Query {
-    static const Graph* _graph;
-    static NodeSet emptyNodeSet;
+    static thread_local NodeSet emptyNodeSet;
+
+    /// @brief The edge type selected by one of the *_EDGES conditions, None
+    /// for any other condition.
+    static EdgeType edgeType(const EdgeCondition& edgeCondition);
+
+    /// @brief Calls func with the edges e stands for when it is a CG edge
+    /// to or from a SignatureHub: one from the call_indirect to each callee
+    /// on the other side of the hub. They are views built on the stack, see
+    /// Edge, and do not outlive the call to func. The condition is tested
+    /// on each of them.
+    template <class F>
+    static void forEachThroughHub(Edge* e,
+                                  Node* hub,
+                                  const EdgeCondition& edgeCondition,
+                                  bool reverse,
+                                  F& func) {
+        if (reverse) {
+            for (Edge* call : hub->inEdges(EdgeType::CG)) {
+                CGEdge view(call->src(), e->dest());
+                if (edgeCondition(&view)) {
+                    func(&view, call->src());
+                }
+            }
+        } else {
+            for (Edge* callee : hub->outEdges(EdgeType::CG)) {
+                CGEdge view(e->src(), callee->dest());
+                if (edgeCondition(&view)) {
+                    func(&view, callee->dest());
+                }
+            }
+        }
+    }
 
 public:
     static NodeSet& getEmptyNodeSet() {
@@ -25,11 +117,15 @@ public:
         return emptyNodeSet;
     }
 
-    static void setGraph(const Graph* graph) {
-        assert(graph != nullptr);
-        _graph = graph;
+    /// @brief The graph of the QueryContext of the calling thread
+    static const Graph& graph() {
+        assert(QueryContext::current() != nullptr);
+        return QueryContext::current()->graph();
     }
 
+    /// @brief Node and edge counts of the graph being queried
+    static const GraphStats& stats() { return graph().getStats(); }
+
 public:
     static const Predicate& TRUE_PREDICATE;
     /// @brief Condition to return all edges
@@ -49,6 +145,74 @@ public:
 
     static EdgeCondition pdgEdge(std::string label, PDGType pdgType);
 
+    /// @brief Calls func with every edge of node that satisfies edgeCondition
+    /// and the node at its other end, in EdgeSet order. Walks the CSR index
+    /// of the graph when it has been frozen. A call_indirect linked to a
+    /// SignatureHub is given edges from the call to the callees of the hub,
+    /// and those callees edges from the call, as if the hub were not there.
+    /// @param node Source node
+    /// @param edgeCondition Edge condition to be taken.
+    /// @param reverse Follow the in-edges instead of the out-edges.
+    /// @param func Function called with the edge and the neighbour.
+    template <class F>
+    static void forEachNeighbour(Node* node,
+                                 const EdgeCondition& edgeCondition,
+                                 bool reverse,
+                                 F func) {
+        const QueryContext* context = QueryContext::current();
+        const FrozenIndex* index =
+            context != nullptr ? context->graph().getFrozenIndex() : nullptr;
+        EdgeType only = edgeType(edgeCondition);
+        bool test = only == EdgeType::None && &edgeCondition != &ALL_EDGES;
+        if (index == nullptr || !index->contains(node)) {
+            // Without an index the buckets of the node are read in place,
+            // a type at a time.
+            for (unsigned t = 0; t < NUM_EDGE_TYPES; t++) {
+                EdgeType type = static_cast<EdgeType>(t);
+                if (only != EdgeType::None && only != type) {
+                    continue;
+                }
+                EdgeRange edges =
+                    reverse ? node->inEdges(type) : node->outEdges(type);
+                for (Edge* e : edges) {
+                    Node* neighbour = reverse ? e->src() : e->dest();
+                    if (type == EdgeType::CG &&
+                        neighbour->type() == NodeType::SignatureHub) {
+                        forEachThroughHub(e, neighbour, edgeCondition, reverse,
+                                          func);
+                    } else if (!test || edgeCondition(e)) {
+                        func(e, neighbour);
+                    }
+                }
+            }
+            return;
+        }
+        Index row = index->row(node);
+        for (unsigned t = 0; t < NUM_EDGE_TYPES; t++) {
+            EdgeType type = static_cast<EdgeType>(t);
+            if (only != EdgeType::None && only != type) {
+                continue;
+            }
+            auto& csr = index->adjacency(type, reverse);
+            for (Index i = csr.begin(row); i < csr.end(row); i++) {
+                Edge* e = index->edge(csr.edges[i]);
+                Node* neighbour = index->node(csr.neighbours[i]);
+                if (type == EdgeType::CG &&
+                    neighbour->type() == NodeType::SignatureHub) {
+                    forEachThroughHub(e, neighbour, edgeCondition, reverse,
+                                      func);
+                } else if (!test || edgeCondition(e)) {
+                    func(e, neighbour);
+                }
+            }
+        }
+    }
+
+    /// @brief The edges of node, its in-edges with reverse, with the CG
+    /// edges through a SignatureHub replaced by an edge from the call to
+    /// each callee, see QueryContext::hubEdge.
+    static EdgeSet edges(Node* node, bool reverse);
+
     /// @brief Returns the childrens of the given nodes.
     /// @param nodes Set of nodes
     /// @param edgeCondition Edge condition to be taken.
@@ -241,12 +405,13 @@ public:
 
             visited.insert(firstNode.first);
             std::list<std::pair<Node*, T>> nodesToInsert;
-            for (Edge* e : Query::filterEdges(firstNode.first->outEdges(),
-                                              edgeCondition)) {
-                if (visited.count(e->dest()) == 0) {
-                    nodesToInsert.emplace_back(e->dest(), nextAux.second);
-                }
-            }
+            forEachNeighbour(firstNode.first, edgeCondition, false,
+                             [&](Edge*, Node* dest) {
+                                 if (visited.count(dest) == 0) {
+                                     nodesToInsert.emplace_back(
+                                         dest, nextAux.second);
+                                 }
+                             });
             dfsNodes.splice(dfsNodes.begin(), nodesToInsert);
         }
     }
@@ -264,6 +429,35 @@ public:
 
     static Node* function(Node* node);
 
+    /// @brief Whether every CFG path from the start of the function of b to b
+    /// goes through a. A node dominates itself.
+    /// @return False if the nodes are in different functions or one of them
+    /// cannot be reached from the start of its function.
+    static bool dominates(Node* a, Node* b);
+
+    /// @brief Whether every CFG path from b to the end of its function goes
+    /// through a. A node post-dominates itself.
+    /// @return False if the nodes are in different functions or one of them
+    /// never reaches the end of its function.
+    static bool postDominates(Node* a, Node* b);
+
+    /// @brief Returns the headers of the loops of the given functions, their
+    /// loop instructions, see LoopForest.
+    static NodeSet loops(const NodeSet& functions);
+
+    /// @brief Header of the innermost loop node is in, null if none.
+    static Node* loopHeader(Node* node);
+
+    /// @brief Number of loops node is in.
+    static Index loopDepth(Node* node);
+
+    /// @brief Nodes of the loop with the given header, inner loops included.
+    /// Empty if header heads no loop.
+    static NodeSet loopBody(Node* header);
+
+    /// @brief CFG edges that leave the loop with the given header.
+    static EdgeSet loopExits(Node* header);
+
     /// @brief Returns all the instructions of the given functions that
     /// satisfies the nodeCondition
     /// @param nodes A set of function nodes.
@@ -320,6 +514,22 @@ class Predicate {
         return res;
     }
 
+    bool evaluateRow(
+        const PropertyColumns& columns,
+        Index id,
+        const std::vector<std::shared_ptr<Predicate>>& predicates) const {
+        if (predicates.size() == 0) {
+            return false;
+        }
+        bool res = true;
+        Index i = 0;
+        while (res && i < predicates.size()) {
+            res = res && predicates[i]->evaluate(columns, id);
+            i++;
+        }
+        return res;
+    }
+
 public:
     Predicate() { _predicates.emplace_back(); }
     Predicate(const Predicate& predicate)
@@ -336,6 +546,18 @@ public:
         return res;
     }
 
+    /// @brief Evaluates the predicate for the node with the given id, reading
+    /// the property columns of its graph where possible.
+    virtual bool evaluate(const PropertyColumns& columns, Index id) const {
+        bool res = false;
+        Index i = 0;
+        while (!res && i < _predicates.size()) {
+            res = res || evaluateRow(columns, id, _predicates[i]);
+            i++;
+        }
+        return res;
+    }
+
     Predicate& insert(std::function<bool(Node* node)> f);
 
     inline Predicate& insert(Predicate& predicate) {
@@ -358,6 +580,12 @@ public:
         return *this;                                                         \
     }
 
+#define WASMATI_PREDICATE_COLUMN(funcName, TypeVal) \
+    Predicate& funcName(TypeVal val, bool eq = true);
+
+#define WASMATI_PREDICATE_SYMBOL(funcName) \
+    Predicate& funcName(std::string val, bool eq = true);
+
     Predicate& value(Type val, bool eq = true) {
         auto f = [&](Node* node) { return (node->value().type == val) == eq; };
         insert(f);
@@ -392,6 +620,8 @@ public:
     }
 #include "src/config/predicates.def"
 #undef WASMATI_PREDICATE
+#undef WASMATI_PREDICATE_COLUMN
+#undef WASMATI_PREDICATE_SYMBOL
 #undef WASMATI_PREDICATE_VALUES_I
 #undef WASMATI_PREDICATE_VALUES_F
 
@@ -489,10 +719,12 @@ public:
     }
 
     Predicate& inEdge(EdgeType val, std::string label, bool eq = true) {
-        auto f = [=](Node* node) {
+        SymbolMatcher matcher(label);
+        auto f = [=](Node* node) mutable {
             auto edges = node->inEdges(val);
             for (auto e : edges) {
-                if (e->label() == label) {
+                if (matcher.matches(node->graph()->strings(),
+                                    e->labelSymbol())) {
                     return true == eq;
                 }
             }
@@ -517,10 +749,13 @@ public:
     }
 
     Predicate& inPDGEdge(std::string label, PDGType pdgType, bool eq = true) {
-        auto f = [=](Node* node) {
+        SymbolMatcher matcher(label);
+        auto f = [=](Node* node) mutable {
             auto edges = node->inEdges(EdgeType::PDG);
             for (auto e : edges) {
-                if (e->label() == label && e->pdgType() == pdgType) {
+                if (e->pdgType() == pdgType &&
+                    matcher.matches(node->graph()->strings(),
+                                    e->labelSymbol())) {
                     return true == eq;
                 }
             }
@@ -562,13 +797,18 @@ public:
 
     Predicate& outPDGEdge(Edge*& edge, PDGType pdgType, bool eq = true) {
         auto f = [&, pdgType, eq](Node* node) {
-            auto edges = node->outEdges(EdgeType::PDG);
-            for (auto e : edges) {
-                if (e->pdgType() == pdgType) {
-                    edge = e;
-                    return true == eq;
+            // picks the least edge in EdgeSet order
+            Edge* found = nullptr;
+            for (auto e : node->outEdges(EdgeType::PDG)) {
+                if (e->pdgType() == pdgType &&
+                    (found == nullptr || CompareEdge()(e, found))) {
+                    found = e;
                 }
             }
+            if (found != nullptr) {
+                edge = found;
+                return true == eq;
+            }
             return false == eq;
         };
         insert(f);
@@ -580,14 +820,19 @@ public:
         auto f = [&, in](Node* node) {                                \
             auto edges = in ? node->inEdges(EdgeType::PDG)            \
                             : node->outEdges(EdgeType::PDG);          \
+            Edge* found = nullptr;                                    \
             for (auto e : edges) {                                    \
                 if (e->pdgType() == PDGType::Const &&                 \
-                    e->value().type == rtype) {                       \
-                    val = Utils::value##funcName(e->value());         \
-                    return true;                                      \
+                    e->value().type == rtype &&                       \
+                    (found == nullptr || CompareEdge()(e, found))) {  \
+                    found = e;                                        \
                 }                                                     \
             }                                                         \
-            return false;                                             \
+            if (found == nullptr) {                                   \
+                return false;                                         \
+            }                                                         \
+            val = Utils::value##funcName(found->value());             \
+            return true;                                              \
         };                                                            \
         insert(f);                                                    \
         return *this;                                                 \
@@ -598,14 +843,19 @@ public:
         auto f = [&, in](Node* node) {                                \
             auto edges = in ? node->inEdges(EdgeType::PDG)            \
                             : node->outEdges(EdgeType::PDG);          \
+            Edge* found = nullptr;                                    \
             for (auto e : edges) {                                    \
                 if (e->pdgType() == PDGType::Const &&                 \
-                    e->value().type == rtype) {                       \
-                    val = Utils::value##funcName(e->value());         \
-                    return true;                                      \
+                    e->value().type == rtype &&                       \
+                    (found == nullptr || CompareEdge()(e, found))) {  \
+                    found = e;                                        \
                 }                                                     \
             }                                                         \
-            return false;                                             \
+            if (found == nullptr) {                                   \
+                return false;                                         \
+            }                                                         \
+            val = Utils::value##funcName(found->value());             \
+            return true;                                              \
         };                                                            \
         insert(f);                                                    \
         return *this;                                                 \
@@ -623,6 +873,9 @@ struct TruePredicate : Predicate {
     TruePredicate() {}
     TruePredicate(TruePredicate&) : Predicate() {}
     bool evaluate(Node* node) const override { return true; }
+    bool evaluate(const PropertyColumns& columns, Index id) const override {
+        return true;
+    }
 };
 
 struct TestHolder : Predicate {
@@ -634,6 +887,55 @@ struct TestHolder : Predicate {
     TestHolder(std::function<bool(Node*)> func) : func(func) {}
 
     bool evaluate(Node* node) const override { return func(node); }
+    bool evaluate(const PropertyColumns& columns, Index id) const override {
+        return func(columns.node(id));
+    }
+};
+
+/// Compares a property with a value, through its column when the predicate
+/// is evaluated by id.
+template <class T>
+struct ColumnTest : Predicate {
+    typedef T (Node::*Getter)() const;
+    typedef std::vector<T> PropertyColumns::*Column;
+
+    const Getter getter;
+    const Column column;
+    const T val;
+    const bool eq;
+
+    ColumnTest(Getter getter, Column column, T val, bool eq)
+        : getter(getter), column(column), val(val), eq(eq) {}
+
+    bool evaluate(Node* node) const override {
+        return ((node->*getter)() == val) == eq;
+    }
+    bool evaluate(const PropertyColumns& columns, Index id) const override {
+        return ((columns.*column)[id] == val) == eq;
+    }
+};
+
+/// Compares an interned property with a string, as a symbol.
+struct SymbolTest : Predicate {
+    typedef Symbol (Node::*Getter)() const;
+    typedef std::vector<Symbol> PropertyColumns::*Column;
+
+    const Getter getter;
+    const Column column;
+    mutable SymbolMatcher matcher;
+    const bool eq;
+
+    SymbolTest(Getter getter, Column column, const std::string& val, bool eq)
+        : getter(getter), column(column), matcher(val), eq(eq) {}
+
+    bool evaluate(Node* node) const override {
+        return matcher.matches(node->graph()->strings(),
+                               (node->*getter)()) == eq;
+    }
+    bool evaluate(const PropertyColumns& columns, Index id) const override {
+        return matcher.matches(columns.graph->strings(),
+                               (columns.*column)[id]) == eq;
+    }
 };
 
 template <class T>
@@ -811,7 +1113,7 @@ public:
 
     Optional<Node*> findFirst() {
         if (nodes.size() > 0) {
-            return Optional<Node*>(*nodes.begin());
+            return Optional<Node*>(nodes.front());
         } else {
             return Optional<Node*>();
         }
@@ -819,7 +1121,7 @@ public:
 
     Optional<Node*> findLast() {
         if (nodes.size() > 0) {
-            return Optional<Node*>(*nodes.rbegin());
+            return Optional<Node*>(nodes.back());
         } else {
             return Optional<Node*>();
         }
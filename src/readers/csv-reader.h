@@ -229,154 +229,164 @@ private:
         auto row = Utils::split(str, ',');
         assert(row.size() == 18);
         Index id = std::stoi(row[NodeCol::id]);
+        // The graph numbers nodes in creation order, every node read so far
+        // has been inserted, so rows have to come sorted by id and dense.
+        assert(id == _graph->getNodes().size());
         NodeType nodeType = NODE_TYPE_MAP_R.at(row[NodeCol::NodeType]);
+        Symbol name = _graph->intern(row[NodeCol::Name]);
+        Symbol label = _graph->intern(row[NodeCol::Label]);
         switch (nodeType) {
         // Module
         case NodeType::Module:
-            return new Module(id, row[NodeCol::Name]);
+            return _graph->newNode<Module>(id, name);
         // Function
         case NodeType::Function:
-            return new Function(id, row[NodeCol::Name],
-                                std::stoi(row[NodeCol::Index]),
-                                std::stoi(row[NodeCol::Nargs]),
-                                std::stoi(row[NodeCol::Nlocals]),
-                                std::stoi(row[NodeCol::Nresults]),
-                                std::stoi(row[NodeCol::IsImport]),
-                                std::stoi(row[NodeCol::IsImport]));
+            return _graph->newNode<Function>(id, name,
+                                             std::stoi(row[NodeCol::Index]),
+                                             std::stoi(row[NodeCol::Nargs]),
+                                             std::stoi(row[NodeCol::Nlocals]),
+                                             std::stoi(row[NodeCol::Nresults]),
+                                             std::stoi(row[NodeCol::IsImport]),
+                                             std::stoi(row[NodeCol::IsImport]));
         // VarNode
         case NodeType::VarNode:
-            return new VarNode(id, row[NodeCol::VarType],
-                               std::stoi(row[NodeCol::Index]),
-                               row[NodeCol::Name]);
+            return _graph->newNode<VarNode>(id, row[NodeCol::VarType],
+                                            std::stoi(row[NodeCol::Index]),
+                                            name);
         // FunctionSignature
         case NodeType::FunctionSignature:
-            return new FunctionSignature(id);
+            return _graph->newNode<FunctionSignature>(id);
         // Instructions
         case NodeType::Instructions:
-            return new Instructions(id);
+            return _graph->newNode<Instructions>(id);
         // Parameters
         case NodeType::Parameters:
-            return new Parameters(id);
+            return _graph->newNode<Parameters>(id);
         // Locals
         case NodeType::Locals:
-            return new Locals(id);
+            return _graph->newNode<Locals>(id);
         // Results
         case NodeType::Results:
-            return new Results(id);
+            return _graph->newNode<Results>(id);
         // Else
         case NodeType::Else:
-            return new Else(id);
+            return _graph->newNode<Else>(id);
         // Trap
         case NodeType::Trap:
-            return new Trap(id);
+            return _graph->newNode<Trap>(id);
         // Start
         case NodeType::Start:
-            return new Start(id);
+            return _graph->newNode<Start>(id);
+        // SignatureHub
+        case NodeType::SignatureHub:
+            return _graph->newNode<SignatureHub>(
+                id, name, std::stoi(row[NodeCol::Index]));
         // Instruction
         case NodeType::Instruction: {
             auto instType = INST_TYPE_MAP_R.at(row[NodeCol::InstType]);
             switch (instType) {
             // Nop
             case InstType::Nop:
-                return new NopInst(id);
+                return _graph->newNode<NopInst>(id);
             // Unreachable
             case InstType::Unreachable:
-                return new UnreachableInst(id);
+                return _graph->newNode<UnreachableInst>(id);
             // Return
             case InstType::Return:
-                return new ReturnInst(id);
+                return _graph->newNode<ReturnInst>(id);
             // BrTable
             case InstType::BrTable:
-                return new BrTableInst(id);
+                return _graph->newNode<BrTableInst>(id);
             // Drop
             case InstType::Drop:
-                return new DropInst(id);
+                return _graph->newNode<DropInst>(id);
             // Select
             case InstType::Select:
-                return new SelectInst(id);
+                return _graph->newNode<SelectInst>(id);
             // MemorySize
             case InstType::MemorySize:
-                return new MemorySizeInst(id);
+                return _graph->newNode<MemorySizeInst>(id);
             // MemoryGrow
             case InstType::MemoryGrow:
-                return new MemoryGrowInst(id);
+                return _graph->newNode<MemoryGrowInst>(id);
             // Const
             case InstType::Const:
-                return new ConstInst(id,
-                                     *createConst(row[NodeCol::ConstType],
-                                                  row[NodeCol::ConstValueI],
-                                                  row[NodeCol::ConstValueF]));
+                return _graph->newNode<ConstInst>(
+                    id, *createConst(row[NodeCol::ConstType],
+                                     row[NodeCol::ConstValueI],
+                                     row[NodeCol::ConstValueF]));
             // Binary
             case InstType::Binary:
-                return new BinaryInst(id, row[NodeCol::Opcode]);
+                return _graph->newNode<BinaryInst>(id, row[NodeCol::Opcode]);
             // Compare
             case InstType::Compare:
-                return new CompareInst(id, row[NodeCol::Opcode]);
+                return _graph->newNode<CompareInst>(id, row[NodeCol::Opcode]);
             // Convert
             case InstType::Convert:
-                return new ConvertInst(id, row[NodeCol::Opcode]);
+                return _graph->newNode<ConvertInst>(id, row[NodeCol::Opcode]);
             // Unary
             case InstType::Unary:
-                return new UnaryInst(id, row[NodeCol::Opcode]);
+                return _graph->newNode<UnaryInst>(id, row[NodeCol::Opcode]);
             // Load
             case InstType::Load:
-                return new LoadInst(id, row[NodeCol::Opcode],
-                                    std::stoi(row[NodeCol::Offset]));
+                return _graph->newNode<LoadInst>(
+                    id, row[NodeCol::Opcode], std::stoi(row[NodeCol::Offset]));
             // Store
             case InstType::Store:
-                return new StoreInst(id, row[NodeCol::Opcode],
-                                     std::stoi(row[NodeCol::Offset]));
+                return _graph->newNode<StoreInst>(
+                    id, row[NodeCol::Opcode], std::stoi(row[NodeCol::Offset]));
             // Br
             case InstType::Br:
-                return new BrInst(id, row[NodeCol::Label]);
+                return _graph->newNode<BrInst>(id, label);
             // BrIf
             case InstType::BrIf:
-                return new BrIfInst(id, row[NodeCol::Label]);
+                return _graph->newNode<BrIfInst>(id, label);
             // GlobalGet
             case InstType::GlobalGet:
-                return new GlobalGetInst(id, row[NodeCol::Label]);
+                return _graph->newNode<GlobalGetInst>(id, label);
             // GlobalSet
             case InstType::GlobalSet:
-                return new GlobalSetInst(id, row[NodeCol::Label]);
+                return _graph->newNode<GlobalSetInst>(id, label);
             // LocalGet
             case InstType::LocalGet:
-                return new LocalGetInst(id, row[NodeCol::Label]);
+                return _graph->newNode<LocalGetInst>(id, label);
             // LocalSet
             case InstType::LocalSet:
-                return new LocalSetInst(id, row[NodeCol::Label]);
+                return _graph->newNode<LocalSetInst>(id, label);
             // LocalTee
             case InstType::LocalTee:
-                return new LocalTeeInst(id, row[NodeCol::Label]);
+                return _graph->newNode<LocalTeeInst>(id, label);
             // Call
             case InstType::Call:
-                return new CallInst(id, std::stoi(row[NodeCol::Nargs]),
-                                    std::stoi(row[NodeCol::Nresults]),
-                                    row[NodeCol::Label]);
+                return _graph->newNode<CallInst>(
+                    id, std::stoi(row[NodeCol::Nargs]),
+                    std::stoi(row[NodeCol::Nresults]), label);
             // CallIndirect
             case InstType::CallIndirect:
-                return new CallIndirectInst(id, std::stoi(row[NodeCol::Nargs]),
-                                            std::stoi(row[NodeCol::Nresults]),
-                                            row[NodeCol::Label]);
+                return _graph->newNode<CallIndirectInst>(
+                    id, std::stoi(row[NodeCol::Nargs]),
+                    std::stoi(row[NodeCol::Nresults]), label);
             // BeginBlock
             case InstType::BeginBlock:
-                return new BeginBlockInst(id, std::stoi(row[NodeCol::Nresults]),
-                                          row[NodeCol::Label]);
+                return _graph->newNode<BeginBlockInst>(
+                    id, std::stoi(row[NodeCol::Nresults]), label);
             // Block
             case InstType::Block:
-                return new BlockInst(id, std::stoi(row[NodeCol::Nresults]),
-                                     row[NodeCol::Label]);
+                return _graph->newNode<BlockInst>(
+                    id, std::stoi(row[NodeCol::Nresults]), label);
             // Loop
             case InstType::Loop:
-                return new LoopInst(id, std::stoi(row[NodeCol::Nresults]),
-                                    row[NodeCol::Label]);
+                return _graph->newNode<LoopInst>(
+                    id, std::stoi(row[NodeCol::Nresults]), label);
             // LoopEnd
             case InstType::EndLoop:
-                return new EndLoopInst(id, std::stoi(row[NodeCol::Nresults]),
-                                       row[NodeCol::Label]);
+                return _graph->newNode<EndLoopInst>(
+                    id, std::stoi(row[NodeCol::Nresults]), label);
             // If
             case InstType::If:
-                return new IfInst(id, std::stoi(row[NodeCol::Nresults]),
-                                  std::stoi(row[NodeCol::HasElse]));
+                return _graph->newNode<IfInst>(
+                    id, std::stoi(row[NodeCol::Nresults]),
+                    std::stoi(row[NodeCol::HasElse]));
             default:
                 break;
             }
@@ -393,34 +403,34 @@ private:
         assert(row.size() >= 8);
         Index src = std::stoi(row[EdgeCol::Src]);
         Index dest = std::stoi(row[EdgeCol::Dest]);
-        auto& nodes = _graph->getNodes();
-
-        assert(src < nodes.size() && nodes[src]->id() == src);
-        assert(dest < nodes.size() && nodes[dest]->id() == dest);
+        Node* srcNode = _graph->nodeById(src);
+        Node* destNode = _graph->nodeById(dest);
+        assert(srcNode != nullptr && destNode != nullptr);
 
         std::string type = row[EdgeCol::Type];
         switch (Edge::type(type)) {
         case EdgeType::AST:
-            return new ASTEdge(nodes[src], nodes[dest]);
+            return _graph->newEdge<ASTEdge>(srcNode, destNode);
         case EdgeType::CFG: {
             std::string label = row[EdgeCol::Label];
-            return new CFGEdge(nodes[src], nodes[dest], label);
+            return _graph->newEdge<CFGEdge>(srcNode, destNode, label);
         }
         case EdgeType::PDG: {
             std::string label = row[EdgeCol::Label];
             auto pdgType = PDG_TYPE_MAP_R.at(row[EdgeCol::PdgType]);
             if (pdgType == PDGType::Const) {
-                return new PDGEdgeConst(
-                    nodes[src], nodes[dest],
+                return _graph->newEdge<PDGEdgeConst>(
+                    srcNode, destNode,
                     *createConst(row[EdgeCol::ConstType],
                                  row[EdgeCol::ConstValueI],
                                  row[EdgeCol::ConstValueF]));
             } else {
-                return new PDGEdge(nodes[src], nodes[dest], label, pdgType);
+                return _graph->newEdge<PDGEdge>(srcNode, destNode, label,
+                                                pdgType);
             }
         }
         case EdgeType::CG:
-            return new CGEdge(nodes[src], nodes[dest]);
+            return _graph->newEdge<CGEdge>(srcNode, destNode);
         default:
             assert(false);
             break;
@@ -0,0 +1,112 @@
+#ifndef WASMATI_STRING_TABLE_H
+#define WASMATI_STRING_TABLE_H
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "src/memory-usage.h"
+
+namespace wasmati {
+
+/// Id of a string interned in a StringTable. Symbols of the same table are
+/// equal iff their strings are equal. The default symbol is the empty
+/// string in every table.
+class Symbol {
+    uint32_t _id;
+
+public:
+    Symbol() : _id(0) {}
+    explicit Symbol(uint32_t id) : _id(id) {}
+
+    inline uint32_t id() const { return _id; }
+    inline bool empty() const { return _id == 0; }
+    inline bool operator==(const Symbol& other) const {
+        return _id == other._id;
+    }
+    inline bool operator!=(const Symbol& other) const {
+        return _id != other._id;
+    }
+    inline bool operator<(const Symbol& other) const {
+        return _id < other._id;
+    }
+};
+
+/// Interns the names and labels of a graph so they are stored and compared
+/// as 32-bit ids.
+class StringTable {
+    std::unordered_map<std::string, Symbol> _symbols;
+    std::vector<const std::string*> _strings;
+
+public:
+    StringTable() { intern(""); }
+    StringTable(const StringTable&) = delete;
+    StringTable& operator=(const StringTable&) = delete;
+
+    inline Symbol intern(const std::string& str) {
+        auto it = _symbols.find(str);
+        if (it != _symbols.end()) {
+            return it->second;
+        }
+        Symbol symbol(static_cast<uint32_t>(_strings.size()));
+        it = _symbols.emplace(str, symbol).first;
+        _strings.push_back(&it->first);
+        return symbol;
+    }
+
+    /// Looks up a string without interning it. Returns false if no symbol
+    /// was made for it.
+    inline bool find(const std::string& str, Symbol& symbol) const {
+        auto it = _symbols.find(str);
+        if (it == _symbols.end()) {
+            return false;
+        }
+        symbol = it->second;
+        return true;
+    }
+
+    inline const std::string& str(Symbol symbol) const {
+        assert(symbol.id() < _strings.size());
+        return *_strings[symbol.id()];
+    }
+
+    inline size_t size() const { return _strings.size(); }
+
+    inline size_t getMemoryUsage() const {
+        size_t result = sizeof(*this);
+        result += memory::heapBytes(_strings) + memory::heapBytes(_symbols);
+        for (auto const& kv : _symbols) {
+            result += memory::heapBytes(kv.first);
+        }
+        return result;
+    }
+};
+
+/// Compares symbols against a fixed string. The string is resolved once per
+/// table, and again only if the table grew while the string was missing.
+class SymbolMatcher {
+    std::string _str;
+    const StringTable* _table;
+    size_t _tableSize;
+    Symbol _symbol;
+    bool _found;
+
+public:
+    explicit SymbolMatcher(const std::string& str)
+        : _str(str), _table(nullptr), _tableSize(0), _found(false) {}
+
+    inline const std::string& str() const { return _str; }
+
+    inline bool matches(const StringTable& table, Symbol symbol) {
+        if (_table != &table || (!_found && _tableSize != table.size())) {
+            _table = &table;
+            _tableSize = table.size();
+            _found = table.find(_str, _symbol);
+        }
+        return _found && symbol == _symbol;
+    }
+};
+
+}  // namespace wasmati
+
+#endif /* WASMATI_STRING_TABLE_H */
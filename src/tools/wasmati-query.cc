@@ -54,6 +54,11 @@ static void ParseOptions(int argc, char** argv) {
                      });
     parser.AddOption("native", "Execute native queries.",
                      []() { native = true; });
+    parser.AddOption("basic-blocks",
+                     "Group the CFG into basic blocks once the graph is "
+                     "loaded, so reachability over CFG edges moves a block "
+                     "at a time.",
+                     []() { cpgOptions.basicBlocks = true; });
     parser.Parse(argc, argv);
 }
 
@@ -73,10 +78,12 @@ int ProgramMain(int argc, char** argv) {
     VulnerabilityChecker::verifyConfig(config);
 
     graph = new Graph();
+    std::unique_ptr<GraphSnapshot> snapshot;
     if (!s_zipfile.empty()) {
         auto start = std::chrono::high_resolution_clock::now();
         CSVReader reader(s_zipfile, graph);
         auto stat = reader.readGraph();
+        snapshot.reset(new GraphSnapshot(*graph));
         auto end = std::chrono::high_resolution_clock::now();
         auto loadDuration =
             std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
@@ -87,7 +94,10 @@ int ProgramMain(int argc, char** argv) {
                       << std::endl;
         }
     }
-    Query::setGraph(graph);
+    if (!snapshot) {
+        snapshot.reset(new GraphSnapshot(*graph));
+    }
+    QueryContext context(*snapshot);
 
     // Evaluate file if provided
     Evaluator evaluator = Evaluator(config, s_infile);
@@ -9,6 +9,7 @@
 #include "src/generate-names.h"
 #include "src/graph.h"
 #include "src/ir.h"
+#include "src/memory-usage.h"
 #include "src/option-parser.h"
 #include "src/options.h"
 #include "src/pdg-builder.h"
@@ -24,6 +25,9 @@
 #include "src/writers/dot-writer.h"
 #include "src/writers/json-writer.h"
 
+#include <cstdlib>
+#include <thread>
+
 using namespace wabt;
 using namespace wasmati;
 
@@ -52,6 +56,8 @@ static bool s_read_debug_names = true;
 static bool s_fail_on_custom_section_error = true;
 static std::unique_ptr<FileStream> s_log_stream;
 static std::unique_ptr<FileStream> s_info_stream;
+// Builder of the deferred PDG with --lazy.
+static std::shared_ptr<PDG> s_lazy_pdg;
 static bool s_validate = true;
 
 static const char s_description[] =
@@ -128,6 +134,43 @@ static void ParseOptions(int argc, char** argv) {
                          cpgOptions.loopName = argument;
                          cpgOptions.loopName = "$" + cpgOptions.loopName;
                      });
+    parser.AddOption("threads", "N",
+                     "Build the functions of the graph on N threads, 0 for "
+                     "one per hardware thread. The graph is the same for "
+                     "any N.",
+                     [](const char* argument) {
+                         int threads = atoi(argument);
+                         if (threads < 0) {
+                             fprintf(stderr, "invalid number of threads: %s\n",
+                                     argument);
+                             exit(1);
+                         }
+                         cpgOptions.threads =
+                             threads > 0 ? static_cast<unsigned>(threads)
+                                         : std::thread::hardware_concurrency();
+                     });
+    parser.AddOption("stream",
+                     "Build the AST and CFG of one function at a time and "
+                     "free its body from the module right after, lowering "
+                     "peak memory. Functions are built on a single thread.",
+                     []() { cpgOptions.stream = true; });
+    parser.AddOption("lazy",
+                     "Build the PDG of a function only when a query first "
+                     "reads the edges of its instructions. Queries give the "
+                     "same results.",
+                     []() { cpgOptions.lazy = true; });
+    parser.AddOption("basic-blocks",
+                     "Group the CFG into basic blocks once it is built, so "
+                     "the PDG builder and reachability over CFG edges move "
+                     "a block at a time.",
+                     []() { cpgOptions.basicBlocks = true; });
+    parser.AddOption("signature-hubs",
+                     "Link each call_indirect to one node per table and "
+                     "function type that has the CG edges to the functions "
+                     "of that table with that type, instead of to each "
+                     "function. Queries and the edges the query language "
+                     "hands out are the same as without it.",
+                     []() { cpgOptions.signatureHubs = true; });
     s_features.AddOptions(&parser);
     parser.AddOption("ignore-custom-section-errors",
                      "Ignore errors in custom sections",
@@ -164,6 +207,8 @@ int ProgramMain(int argc, char** argv) {
     InitStdio();
     ParseOptions(argc, argv);
     Graph* graph = nullptr;
+    std::unique_ptr<GraphSnapshot> snapshot;
+    std::unique_ptr<QueryContext> context;
     json output;
 
     // Parse and validate Config file
@@ -191,7 +236,8 @@ int ProgramMain(int argc, char** argv) {
         graph = new Graph();
         CSVReader reader(s_infile, graph);
         reader.readGraph();
-        Query::setGraph(graph);
+        snapshot.reset(new GraphSnapshot(*graph));
+        context.reset(new QueryContext(*snapshot));
     } else {
         WABT_FATAL("Unable to verify file type: %s\n", s_infile.c_str());
     }
@@ -207,13 +253,20 @@ int ProgramMain(int argc, char** argv) {
             std::chrono::duration_cast<std::chrono::milliseconds>(parsing -
                                                                   start);
         info["parsing"] = parsingDuration.count();
+        info["peakRSS"]["parsing"] = memory::peakRSS();
     }
 
     // Generate graph
     if (!is_zip) {
         graph = new Graph(*module.get());
-        Query::setGraph(graph);
         generateCPG(*graph);
+        // A --lazy graph is still written as it is queried, see Graph::defer.
+        if (graph->hasDeferred()) {
+            context.reset(new QueryContext(*graph));
+        } else {
+            snapshot.reset(new GraphSnapshot(*graph));
+            context.reset(new QueryContext(*snapshot));
+        }
     }
 
     // Execute native queries
@@ -228,11 +281,17 @@ int ProgramMain(int argc, char** argv) {
                 std::chrono::duration_cast<std::chrono::milliseconds>(
                     endVulns - startVulns);
             info["query"] = queryDuration.count();
+            info["peakRSS"]["query"] = memory::peakRSS();
         }
 
         output["vulnerabilities"] = vulns;
     }
 
+    // The writers and the info output see the whole graph
+    if (generate_csv || generate_dot || generate_json || generate_datalog_dir ||
+        cpgOptions.info) {
+        graph->materializeAll();
+    }
     // generate csv
     if (Succeeded(result) && generate_csv) {
         CSVWriter writer(s_csv_outfile, graph);
@@ -265,7 +324,16 @@ int ProgramMain(int argc, char** argv) {
         info["total"] = totalDuration.count();
         info["nodes"] = graph->getNumberNodes();
         info["edges"] = graph->getNumberEdges();
+        info["stats"] = graph->getStats();
         info["memory"] = graph->getMemoryUsage();
+        info["memoryUsage"]["graph"] = graph->getMemory();
+        if (s_lazy_pdg) {
+            info["memoryUsage"]["builders"]["pdg"] =
+                s_lazy_pdg->getPeakMemoryUsage();
+        }
+        info["memoryUsage"]["queries"] = context->getMemoryUsage();
+        info["arena"] = graph->getArenaUsage();
+        info["peakRSS"]["total"] = memory::peakRSS();
         output["info"] = info;
     }
 
@@ -358,33 +426,97 @@ Result wasmFile(std::unique_ptr<wabt::Module>* mod) {
 
 void generateCPG(Graph& graph) {
     auto start = std::chrono::high_resolution_clock::now();
+    // The builders query the graph while it is being built.
+    QueryContext context(graph);
 
     AST ast(graph.getModuleContext(), graph);
-    ast.generateAST();
-    auto astTime = std::chrono::high_resolution_clock::now();
-
     CFG cfg(graph.getModuleContext(), graph, ast);
-    cfg.generateCFG();
+    // Time spent in the AST builder, interleaved with the CFG one when
+    // streaming.
+    std::chrono::high_resolution_clock::duration astTime{};
+    auto timeAST = [&astTime](std::function<void()> step) {
+        auto begin = std::chrono::high_resolution_clock::now();
+        step();
+        astTime += std::chrono::high_resolution_clock::now() - begin;
+    };
+    if (cpgOptions.stream) {
+        // A body is freed as soon as its CFG is built, so the module shrinks
+        // while the graph grows instead of both being whole at once.
+        timeAST([&ast]() { ast.beginAST(); });
+        Index func_index = 0;
+        for (auto f : graph.getModuleContext().module.funcs) {
+            if (cpgOptions.funcName.empty() ||
+                cpgOptions.funcName.compare(f->name) == 0) {
+                timeAST([&]() { ast.generateFunction(f, func_index); });
+                cfg.generateFunction(f, func_index);
+                timeAST([&]() { ast.releaseBody(f); });
+            }
+            func_index++;
+        }
+        timeAST([&ast]() { ast.endAST(); });
+        if (cpgOptions.info) {
+            info["memoryUsage"]["builders"]["ast"] = ast.getMemoryUsage();
+            info["peakRSS"]["ast"] = memory::peakRSS();
+        }
+        cfg.generateCalls();
+    } else {
+        timeAST([&ast]() { ast.generateAST(); });
+        if (cpgOptions.info) {
+            info["memoryUsage"]["builders"]["ast"] = ast.getMemoryUsage();
+            info["peakRSS"]["ast"] = memory::peakRSS();
+        }
+        cfg.generateCFG();
+    }
     auto cfgTime = std::chrono::high_resolution_clock::now();
+    if (cpgOptions.info) {
+        info["memoryUsage"]["builders"]["cfg"] = cfg.getMemoryUsage();
+        info["peakRSS"]["cfg"] = memory::peakRSS();
+    }
 
-    PDG pdg(graph.getModuleContext(), graph);
-    pdg.generatePDG();
+    if (cpgOptions.basicBlocks) {
+        graph.indexBasicBlocks();
+    }
+    if (cpgOptions.lazy) {
+        s_lazy_pdg = PDG::defer(graph.getModuleContext(), graph);
+    } else {
+        PDG pdg(graph.getModuleContext(), graph);
+        pdg.generatePDG();
+        if (cpgOptions.info) {
+            info["memoryUsage"]["builders"]["pdg"] = pdg.getPeakMemoryUsage();
+        }
+    }
     auto pdgTime = std::chrono::high_resolution_clock::now();
+    if (cpgOptions.info) {
+        info["peakRSS"]["pdg"] = memory::peakRSS();
+    }
+
+    if (graph.hasDeferred()) {
+        graph.freeze();
+    } else {
+        graph.seal();
+    }
+    auto freezeTime = std::chrono::high_resolution_clock::now();
+    if (cpgOptions.info) {
+        info["peakRSS"]["freeze"] = memory::peakRSS();
+    }
 
     if (cpgOptions.info) {
         auto astDuration =
-            std::chrono::duration_cast<std::chrono::milliseconds>(astTime -
-                                                                  start);
+            std::chrono::duration_cast<std::chrono::milliseconds>(astTime);
         auto cfgDuration =
-            std::chrono::duration_cast<std::chrono::milliseconds>(cfgTime -
-                                                                  astTime);
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                cfgTime - start - astTime);
         auto pdgDuration =
             std::chrono::duration_cast<std::chrono::milliseconds>(pdgTime -
                                                                   cfgTime);
         info["ast"] = astDuration.count();
         info["cfg"] = cfgDuration.count() - cfg.totalTime;
+        auto freezeDuration =
+            std::chrono::duration_cast<std::chrono::milliseconds>(freezeTime -
+                                                                  pdgTime);
         info["pdg"] = pdgDuration.count();
         info["cg"] = cfg.totalTime;
+        info["freeze"] = freezeDuration.count();
     }
 }
 
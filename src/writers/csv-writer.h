@@ -210,6 +210,14 @@ private:
     void visitElse(Else* node) override { visitSimpleNode(node); }
     void visitStart(Start* node) override { visitSimpleNode(node); }
     void visitTrap(Trap* node) override { visitSimpleNode(node); }
+    void visitSignatureHub(SignatureHub* node) override {
+        auto nodes = getNodesMap();
+        nodes[ID] = std::to_string(node->id());
+        nodes[NODE_TYPE] = NODE_TYPE_MAP.at(node->type());
+        nodes[NAME] = node->name();
+        nodes[INDEX] = std::to_string(node->index());
+        writeNode(nodes);
+    }
     void visitVarNode(VarNode* node) override {
         auto nodes = getNodesMap();
         nodes[ID] = std::to_string(node->id());
@@ -42,6 +42,7 @@ constexpr auto BASE_DL = R"(#ifndef WASMATI_DATALOG
 .decl else(x:unsigned)
 .decl trap(x:unsigned)
 .decl start(x:unsigned)
+.decl signatureHub(x:unsigned, name:symbol, table:unsigned)
 .decl instruction(x:unsigned, type:symbol)
 .decl nop(x:unsigned)
 .decl unreachable(x:unsigned)
@@ -77,8 +78,9 @@ constexpr auto BASE_DL = R"(#ifndef WASMATI_DATALOG
 astEdge(x, y) :- edge(x, y, "AST", _, _, _).
 cpgEdge(x, y, label) :- edge(x, y, "CFG", label, _, _).
 pdgEdge(x, y, label, type, value) :- edge(x , y, "PDG", label, type,value).
-cgEdge(x,y) :- edge(x, y, "CG", _, _, _).
-pgEdge(x,y) :- edge(x, y, "CG", _, _, _).
+cgEdge(x,y) :- edge(x, y, "CG", _, _, _), !signatureHub(x, _, _), !signatureHub(y, _, _).
+cgEdge(x,y) :- edge(x, h, "CG", _, _, _), signatureHub(h, _, _), edge(h, y, "CG", _, _, _).
+pgEdge(x,y) :- cgEdge(x, y).
 
 // -- Nodes
 // ---- Other Nodes
@@ -93,6 +95,7 @@ results(x) :- node(x, "Results", _, _, _, _, _, _, _, _, _, _, _, _, _, _).
 else(x) :- node(x, "Else", _, _, _, _, _, _, _, _, _, _, _, _, _, _).
 trap(x) :- node(x, "Trap", _, _, _, _, _, _, _, _, _, _, _, _, _, _).
 start(x) :- node(x, "Start", _, _, _, _, _, _, _, _, _, _, _, _, _, _).
+signatureHub(x, name, table) :- node(x, "SignatureHub", name, table, _, _, _, _, _, _, _, _, _, _, _, _).
 // ---- Instructions
 instruction(x, instType) :- node(x, "Instruction", _, _, _, _, _, _, _, _, instType, _, _, _, _, _).
 nop(x) :- node(x, _, _, _, _, _, _, _, _, _, "Nop", _, _, _, _, _).
@@ -269,6 +272,10 @@ private:
     void visitTrap(Trap* node) override {
         _nodes->Writef("%u,Trap,,0,0,0,0,0,0,,,,[,0,0],,0,0\n", node->id());
     }
+    void visitSignatureHub(SignatureHub* node) override {
+        _nodes->Writef("%u,SignatureHub,%s,%u,0,0,0,0,0,,,,[,0,0],,0,0\n",
+                       node->id(), node->name().c_str(), node->index());
+    }
     void visitVarNode(VarNode* node) override {
         _nodes->Writef("%u,VarNode,%s,%u,0,0,0,0,0,%s,,,[,0,0],,0,0\n",
                        node->id(), node->name().c_str(), node->index(),
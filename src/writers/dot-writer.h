@@ -64,7 +64,7 @@ public:
         if (!(cpgOptions.printAll || cpgOptions.printCFG)) {
             return;
         }
-        if (e->_label.empty()) {
+        if (e->labelSymbol().empty()) {
             _stream->Writef("%u -> %u [color=red]\n", e->src()->id(),
                             e->dest()->id());
         } else {
@@ -77,7 +77,7 @@ public:
         if (!(cpgOptions.printAll || cpgOptions.printPDG)) {
             return;
         }
-        if (e->_label.empty()) {
+        if (e->labelSymbol().empty()) {
             _stream->Writef("%u -> %u [color=blue]\n", e->src()->id(),
                             e->dest()->id());
         } else {
@@ -147,6 +147,16 @@ private:
     void visitTrap(Trap* node) override {
         visitSimpleNode(node->id(), node->getNodeName());
     }
+    void visitSignatureHub(SignatureHub* node) override {
+        _stream->Writef(
+            "%u [label="
+            "<<TABLE>"
+            "<TR><TD>SignatureHub</TD></TR>"
+            "<TR><TD>table = %u</TD></TR>"
+            "<TR><TD>type = %s</TD></TR>"
+            "</TABLE>>];\n",
+            node->id(), node->index(), node->name().c_str());
+    }
     void visitVarNode(VarNode* node) override {
         _stream->Writef(
             "%u [label="
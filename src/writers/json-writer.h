@@ -166,6 +166,16 @@ private:
     void visitTrap(Trap* node) override {
         visitSimpleNode(node, node->getNodeName());
     }
+    void visitSignatureHub(SignatureHub* node) override {
+        json nodeJson;
+        nodeJson["inEdges"] = json::array();
+        nodeJson["outEdges"] = json::array();
+        nodeJson["id"] = node->id();
+        nodeJson["type"] = "SignatureHub";
+        nodeJson["name"] = node->name();
+        nodeJson["index"] = node->index();
+        _graphJson["nodes"].emplace_back(nodeJson);
+    }
     void visitVarNode(VarNode* node) override {
         json nodeJson;
         nodeJson["inEdges"] = json::array();
@@ -0,0 +1,13 @@
+#include <emscripten.h>
+#include <stdio.h>
+
+// BoScanfLoops reports readLine: scanf writes to buf until a '\n' is read,
+// whatever the size of buf.
+void EMSCRIPTEN_KEEPALIVE readLine() {
+    char buf[16];
+    char* p = buf;
+    do {
+        scanf("%c", p);
+    } while (*p++ != '\n');
+    printf("%s\n", buf);
+}
@@ -0,0 +1,26 @@
+;;; TOOL: wat2wasm
+;; The PDG is the same with and without --basic-blocks, --lazy or not. The
+;; straight-line runs inside and after the loop are walked a block at a time.
+(module
+  (global $g (mut i32) (i32.const 0))
+  (func $sum (param $n i32) (result i32) (local $i i32) (local $s i32)
+    i32.const 0
+    local.set $s
+    loop $L
+      local.get $s
+      local.get $i
+      i32.add
+      local.set $s
+      local.get $i
+      i32.const 1
+      i32.add
+      local.tee $i
+      local.get $n
+      i32.lt_s
+      br_if $L
+    end
+    local.get $s
+    global.get $g
+    i32.add
+    global.set $g
+    local.get $s))
@@ -0,0 +1,26 @@
+;;; TOOL: wat2wasm
+;;; ARGS: --enable-reference-types
+;; $t0 and $t1 have the same type but are in different tables. The
+;; call_indirect of $main only reaches $t1, with and without
+;; --signature-hubs, and the hub of table 1 leads from the call to $t1.
+(module
+  (type $t (func (result i32)))
+  (table $tab0 1 funcref)
+  (table $tab1 1 funcref)
+  (elem (table $tab0) (i32.const 0) func $t0)
+  (elem (table $tab1) (i32.const 0) func $t1)
+
+  (func $t0 (result i32)
+    (i32.const 0)
+  )
+
+  (func $t1 (result i32)
+    (i32.const 1)
+  )
+
+  (func $main (result i32)
+    (call_indirect $tab1 (type $t)
+      (i32.const 0)
+    )
+  )
+)
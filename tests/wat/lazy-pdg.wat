@@ -0,0 +1,21 @@
+;;; TOOL: wat2wasm
+;; With --lazy -i and no --native, no query builds a PDG. The node and edge
+;; counts of the info output must still be the same as without --lazy.
+(module
+  (global $g (mut i32) (i32.const 0))
+  (func $countdown (param $x i32) (result i32) (local $y i32)
+    local.get $x
+    local.set $y
+    loop $L
+      local.get $y
+      i32.const 1
+      i32.sub
+      local.tee $y
+      br_if $L
+    end
+    local.get $y
+    global.set $g
+    global.get $g)
+  (func $main (result i32)
+    i32.const 3
+    call $countdown))
@@ -0,0 +1,33 @@
+;;; TOOL: wat2wasm
+;; $L1 is never branched back to and is still a loop. The body of $L2 keeps
+;; the instructions after its br_if and the begin block of the else branch
+;; of its if. $L3 is inside $L2, with depth 2, and the end of $L3 belongs to
+;; $L2.
+(module
+  (func $loops (param $n i32) (result i32) (local $i i32)
+    loop $L1
+      local.get $n
+      drop
+    end
+    loop $L2
+      loop $L3
+        local.get $i
+        i32.const 1
+        i32.add
+        local.tee $i
+        local.get $n
+        i32.lt_s
+        br_if $L3
+      end
+      local.get $i
+      if
+        nop
+      else
+        nop
+      end
+      local.get $i
+      br_if $L2
+      local.get $n
+      local.set $i
+    end
+    local.get $i))
@@ -0,0 +1,18 @@
+;;; TOOL: wat2wasm
+;; The body of $L is walked again until its reaching definitions stop
+;; changing, so its PDG edges are inserted more than once. The PDG must
+;; hold each of them once, as before the edges were deduplicated through
+;; the hash set of the PDG builder.
+(module
+  (func $count (param $n i32) (result i32) (local $i i32)
+    loop $L
+      local.get $i
+      i32.const 1
+      i32.add
+      local.set $i
+      local.get $i
+      local.get $n
+      i32.lt_s
+      br_if $L
+    end
+    local.get $i))
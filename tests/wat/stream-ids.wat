@@ -0,0 +1,29 @@
+;;; TOOL: wat2wasm
+;; The graph, ids included, is the same with and without --stream: the CFG
+;; of $first makes the trap and end-of-loop nodes before the AST of $second
+;; is built.
+(module
+  (func $first (param $n i32)
+    loop $L1
+      local.get $n
+      i32.eqz
+      if
+        unreachable
+      end
+      local.get $n
+      br_if $L1
+    end)
+  (func $second (param $n i32) (result i32)
+    loop $L2
+      local.get $n
+      if
+        nop
+      else
+        i32.const 1
+        br_if $L2
+      end
+    end
+    local.get $n
+    call $third)
+  (func $third (param $n i32) (result i32)
+    local.get $n))